@@ -0,0 +1,64 @@
+#ifndef SIMHASH_CPU_H
+#define SIMHASH_CPU_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Simhash {
+
+    /**
+     * Instruction set extensions for which kernels may be specialized. Each
+     * level implies all of the ones before it.
+     *
+     * - ISA_POPCNT: the popcnt instruction
+     * - ISA_AVX2: 256-bit integer vectors
+     * - ISA_AVX512: AVX-512 F, BW and VPOPCNTDQ
+     */
+    enum isa_t {
+        ISA_SCALAR = 0,
+        ISA_POPCNT = 1,
+        ISA_AVX2   = 2,
+        ISA_AVX512 = 3
+    };
+
+    /**
+     * The best instruction set supported by the running CPU.
+     */
+    isa_t detect_isa();
+
+    /**
+     * The instruction set kernels should use: the best one supported by the
+     * running CPU, subject to any limit.
+     */
+    isa_t isa();
+
+    /**
+     * Cap the instruction set used by kernels, for example to compare
+     * implementations. Returns the previous limit.
+     */
+    isa_t limit_isa(isa_t limit);
+
+    /**
+     * Population counts without the popcnt instruction.
+     */
+    inline size_t popcount_generic(uint64_t n)
+    {
+        n = n - ((n >> 1) & 0x5555555555555555ULL);
+        n = (n & 0x3333333333333333ULL) + ((n >> 2) & 0x3333333333333333ULL);
+        n = (n + (n >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return static_cast<size_t>((n * 0x0101010101010101ULL) >> 56);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    /**
+     * Population counts with the popcnt instruction, which the CPU must have.
+     */
+    __attribute__((target("popcnt")))
+    inline size_t popcount_popcnt(uint64_t n)
+    {
+        return static_cast<size_t>(__builtin_popcountll(n));
+    }
+#endif
+}
+
+#endif
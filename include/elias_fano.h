@@ -0,0 +1,87 @@
+#ifndef SIMHASH_ELIAS_FANO_H
+#define SIMHASH_ELIAS_FANO_H
+
+#include "simhash.h"
+
+#include <vector>
+
+namespace Simhash {
+
+    /**
+     * A read-only view of sorted hashes in Elias-Fano encoding, as produced
+     * by EliasFano::encode, stored elsewhere (in an Index or a mapped file).
+     *
+     * Each hash is split into its low bits, which are stored verbatim, and
+     * its remaining high bits, which are stored in unary as gaps from the
+     * previous hash's. For n roughly uniform hashes this takes about
+     * 64 - log2(n) + 2.5 bits each, which is close to the least possible.
+     * A skip pointer to every SKIP'th run of equal high bits lets a range be
+     * found without decoding everything before it.
+     *
+     * The encoding is a sequence of uint64 values: the number of hashes, the
+     * number of low bits, the number of distinct high values, the number of
+     * skip pointers, the skip pointers, the low bits, and the high bits.
+     */
+    class EliasFano {
+    public:
+        /**
+         * The number of runs of equal high bits between skip pointers.
+         */
+        static const size_t SKIP = 256;
+
+        /**
+         * Encode `size` sorted hashes.
+         */
+        static std::vector<uint64_t> encode(const hash_t* data, size_t size);
+
+        /**
+         * An empty view.
+         */
+        EliasFano();
+
+        /**
+         * View an encoding of `length` words, throwing std::invalid_argument
+         * if they can't be one. Every structure is checked to lie within
+         * them, so that decoding corrupt words can't read past them.
+         */
+        EliasFano(const uint64_t* words, size_t length);
+
+        /**
+         * Append the hashes in [low, high] to results, in order.
+         */
+        void decode_range(hash_t low, hash_t high, std::vector<hash_t>& results) const;
+
+        /**
+         * Write out every hash, in order.
+         */
+        void decode(hash_t* output) const;
+
+        /**
+         * The number of hashes.
+         */
+        size_t size() const;
+
+        /**
+         * The encoding itself, and its length in words.
+         */
+        const uint64_t* words() const;
+
+        size_t length() const;
+
+    private:
+        const uint64_t* words_;
+        size_t length_;
+        size_t size_;
+        size_t low_bits_;
+        size_t buckets_;
+        const uint64_t* skips_;
+        const uint64_t* low_;
+        const uint64_t* high_;
+        size_t high_words_;
+
+        /* The low bits of the i'th hash. */
+        hash_t low(size_t i) const;
+    };
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef SIMHASH_EXTERNAL_H
+#define SIMHASH_EXTERNAL_H
+
+#include "simhash.h"
+
+#include <functional>
+#include <string>
+
+namespace Simhash {
+
+    /**
+     * Find all matches among hashes too numerous for every permuted table to
+     * be held in memory at once.
+     *
+     * For each permutation, the hashes are permuted and sorted a chunk at a
+     * time, and each chunk written as a sorted run to a temporary file in
+     * `temporary_directory`. The runs are then merged, and each block of
+     * hashes sharing a prefix is checked as it streams past. Roughly
+     * `memory_budget` bytes are used for chunks and merge buffers, though a
+     * single prefix block is always held in memory in its entirety.
+     *
+     * The hashes themselves are only ever read sequentially, and so may for
+     * example be a memory-mapped file. They may contain duplicates.
+     *
+     * Rather than being collected, each match is passed to `emit` exactly once
+     * as it's found, though in no particular order.
+     *
+     * @return the number of matches found */
+    size_t find_all_external(const hash_t* hashes,
+                             size_t count,
+                             size_t number_of_blocks,
+                             size_t different_bits,
+                             size_t memory_budget,
+                             const std::string& temporary_directory,
+                             const std::function<void(const match_t&)>& emit);
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef SIMHASH_FINGERPRINT_H
+#define SIMHASH_FINGERPRINT_H
+
+#include "simhash.h"
+#include "jenkins.h"
+#include "tokenizer.h"
+
+#include <sstream>
+#include <stdexcept>
+
+namespace Simhash {
+
+    /**
+     * Computes the simhash of a piece of text.
+     *
+     * The text is split into tokens by the tokenizer, and each token is hashed
+     * with the hash function. Every window of `window` consecutive tokens is
+     * then a feature, whose hash is maintained as a cyclic polynomial of the
+     * token hashes, updated in constant time as the window moves. Text with
+     * fewer tokens than that has a single feature made of all of them.
+     *
+     * Tokens are hashed where they lie in the caller's buffer, and features
+     * are accumulated in batches on the stack, so nothing is allocated.
+     */
+    template <typename Hash = Jenkins, typename Tokenizer = AlphaTokenizer>
+    class Fingerprinter {
+    public:
+        /* The largest supported window. */
+        static const size_t MAX_WINDOW = 32;
+
+        explicit Fingerprinter(size_t window = 4,
+                               Hash hash = Hash(),
+                               Tokenizer tokenizer = Tokenizer())
+            : window_(window), hash_(hash), tokenizer_(tokenizer)
+        {
+            if (window == 0 || window > MAX_WINDOW)
+            {
+                std::stringstream message;
+                message << "Window must be in [1, " << MAX_WINDOW << "]; got " << window;
+                throw std::invalid_argument(message.str());
+            }
+        }
+
+        hash_t operator()(const char* data, size_t length) const
+        {
+            // The hashes of the tokens in the window, oldest first from `tokens`
+            hash_t window[MAX_WINDOW];
+            hash_t rolling(0);
+            size_t tokens(0);
+
+            const size_t batch_size = 256;
+            hash_t batch[batch_size];
+            size_t batched(0);
+            Accumulator accumulator;
+
+            tokenizer_(data, length, [&](const char* token, size_t size) {
+                hash_t hash = hash_(token, size);
+                size_t slot = tokens % window_;
+
+                /* Every hash in the window moves one rotation along, and the
+                 * one leaving the window has been rotated by `window_`. */
+                rolling = rotate(rolling, 1) ^ hash;
+                if (tokens >= window_)
+                {
+                    rolling ^= rotate(window[slot], window_);
+                }
+                window[slot] = hash;
+
+                if (++tokens >= window_)
+                {
+                    batch[batched++] = rolling;
+                    if (batched == batch_size)
+                    {
+                        accumulator.add(batch, batched);
+                        batched = 0;
+                    }
+                }
+            });
+
+            if (tokens > 0 && tokens < window_)
+            {
+                batch[batched++] = rolling;
+            }
+            accumulator.add(batch, batched);
+            return accumulator.result();
+        }
+
+    private:
+        static hash_t rotate(hash_t hash, size_t bits)
+        {
+            return (hash << bits) | (hash >> ((BITS - bits) % BITS));
+        }
+
+        size_t window_;
+        Hash hash_;
+        Tokenizer tokenizer_;
+    };
+
+    template <typename Hash, typename Tokenizer>
+    const size_t Fingerprinter<Hash, Tokenizer>::MAX_WINDOW;
+}
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef SIMHASH_INDEX_H
+#define SIMHASH_INDEX_H
+
+#include "simhash.h"
+#include "elias_fano.h"
+#include "permutation.h"
+#include "tables.h"
+
+#include <vector>
+
+namespace Simhash {
+
+    class Index {
+    public:
+        /**
+         * Construct an empty index able to answer queries for all hashes
+         * within `different_bits` of a query.
+         *
+         * If `directory_bits` is nonzero, each table also keeps a directory
+         * of where each value of its leading `directory_bits` bits begins,
+         * so that lookups search only that range of the table. It costs
+         * 8 * (2^directory_bits + 1) bytes per table (see directory_bytes),
+         * and makes inserting or removing a single hash linear in its size,
+         * so bulk inserts are preferable. At most MAX_DIRECTORY_BITS.
+         */
+        Index(size_t number_of_blocks, size_t different_bits, size_t directory_bits = 0);
+
+        /* Compressed tables are viewed in place, so copies need views of
+         * their own copies. */
+        Index(const Index& other);
+        Index(Index&& other) = default;
+        Index& operator=(const Index& other);
+        Index& operator=(Index&& other) = default;
+
+        /**
+         * Insert a hash into every table. Returns false if it was already
+         * present.
+         */
+        bool insert(hash_t hash);
+
+        /**
+         * Insert many hashes at once. This is cheaper than inserting them one
+         * at a time, since each table is merged rather than shifted per hash.
+         */
+        void insert(const std::vector<hash_t>& hashes);
+
+        /**
+         * Insert `count` contiguous hashes at once.
+         */
+        void insert(const hash_t* hashes, size_t count);
+
+        /**
+         * Remove a hash from every table. Returns false if it was not present.
+         */
+        bool remove(hash_t hash);
+
+        /**
+         * Encode every table with Elias-Fano (see EliasFano), which takes
+         * about 64 - log2(size()) + 2.5 bits per hash rather than 64, in
+         * place of any directories. Lookups then decode only the runs of
+         * hashes that share a query's prefix. Inserting or removing hashes
+         * afterwards decodes and re-encodes each table in turn.
+         */
+        void compress();
+
+        /**
+         * Whether or not the tables are compressed.
+         */
+        bool compressed() const;
+
+        /**
+         * Whether or not the exact hash is in the index.
+         */
+        bool contains(hash_t hash) const;
+
+        /**
+         * Find all the stored hashes within `different_bits` of the query,
+         * in ascending order.
+         */
+        std::vector<hash_t> find(hash_t query) const;
+
+        /**
+         * Find all the pairs within `different_bits` among a batch of new
+         * hashes, or between one of them and a stored hash, without adding
+         * them to the index. Pairs of stored hashes are not included.
+         *
+         * For each table, the batch is permuted and sorted, and then merged
+         * against the table, skipping ahead through the table to each of the
+         * batch's prefixes. The cost therefore grows with the size of the
+         * batch rather than that of the index. Tables are processed on up to
+         * `threads` threads (0 meaning one per hardware thread).
+         */
+        sorted_matches_t probe(const hash_t* queries, size_t count, size_t threads = 1) const;
+
+        /**
+         * Find the stored hashes within `different_bits` of each of a batch
+         * of queries, as find would for each of them in turn.
+         *
+         * For each table, the batch is permuted and sorted, so that the
+         * table is read in order, and the location of upcoming prefixes is
+         * prefetched while the current one is searched. Tables are processed
+         * on up to `threads` threads (0 meaning one per hardware thread),
+         * which are started for this call alone.
+         */
+        BatchResults find_batch(const hash_t* queries, size_t count, size_t threads = 1) const;
+
+        /**
+         * As above, on the workers of a pool kept between calls, as suits a
+         * stream of batches. With more workers than tables, each table's
+         * share of the batch is split between several of them.
+         */
+        BatchResults find_batch(const hash_t* queries, size_t count, ThreadPool& pool) const;
+
+        /**
+         * The k stored hashes nearest the query, and their distances from
+         * it, nearest first (and then in ascending order). Only hashes within
+         * `different_bits` are found, so there may be fewer than k.
+         *
+         * The nearest so far are kept in a bounded max-heap, so each table is
+         * searched only for hashes as near as the furthest of them. Tables
+         * are searched in order, and since every hash within e bits is seen
+         * by a known point in that order, the search stops as soon as the
+         * furthest of k neighbors is that close.
+         */
+        std::vector<Neighbor> nearest(hash_t query, size_t k) const;
+
+        /**
+         * The number of stored hashes at each distance from the query, from 0
+         * up to and including `different_bits`.
+         */
+        std::vector<size_t> histogram(hash_t query) const;
+
+        /**
+         * The number of distinct hashes stored.
+         */
+        size_t size() const;
+
+        /**
+         * The number of blocks into which hashes are divided.
+         */
+        size_t number_of_blocks() const;
+
+        /**
+         * The maximum number of bits in which matches may differ.
+         */
+        size_t different_bits() const;
+
+        /**
+         * The number of leading bits indexed by each table's directory, or 0
+         * if there are none.
+         */
+        size_t directory_bits() const;
+
+        /**
+         * The memory used by the tables' directories, in bytes.
+         */
+        size_t directory_bytes() const;
+
+        /**
+         * The memory used by the tables themselves, in bytes.
+         */
+        size_t table_bytes() const;
+
+        /**
+         * The permutations, one for each table.
+         */
+        const std::vector<Permutation>& permutations() const;
+
+        /**
+         * Views of the tables, one for each permutation. These are only valid
+         * until the index is next modified.
+         */
+        std::vector<Table> tables() const;
+
+    private:
+        size_t number_of_blocks_;
+        size_t different_bits_;
+        size_t directory_bits_;
+        std::vector<Permutation> permutations_;
+
+        /* Each table holds every stored hash with the corresponding
+         * permutation applied, in sorted order. */
+        std::vector<std::vector<hash_t> > tables_;
+
+        /* The directory of each table, if directory_bits_ is nonzero and
+         * the tables aren't compressed. */
+        std::vector<std::vector<uint64_t> > directories_;
+
+        /* Once compressed, the encoding of each table (in place of tables_)
+         * and views of them. */
+        std::vector<std::vector<uint64_t> > encoded_;
+        std::vector<EliasFano> views_;
+
+        /* Decode a table if need be so that it may be changed, and then
+         * encode it again. */
+        std::vector<hash_t>& open_table(size_t i);
+        void close_table(size_t i);
+
+        void shift_directories(hash_t hash, int delta);
+        Table table(size_t i) const;
+    };
+}
+
+#endif
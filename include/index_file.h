@@ -0,0 +1,126 @@
+#ifndef SIMHASH_INDEX_FILE_H
+#define SIMHASH_INDEX_FILE_H
+
+#include "simhash.h"
+#include "elias_fano.h"
+#include "index.h"
+#include "io.h"
+#include "permutation.h"
+#include "tables.h"
+
+#include <string>
+#include <vector>
+
+namespace Simhash {
+
+    /**
+     * Write an index to path, with every table already permuted and sorted,
+     * so that it can be opened with MappedIndex without any work.
+     *
+     * If `stride` is non-zero, every stride'th hash of each table is also
+     * written to a sparse directory that narrows down searches of it. If the
+     * index has prefix directories (see Index::directory_bits), they are
+     * written too and used in place of the sparse ones. If the index is
+     * compressed (see Index::compress), its tables are written as they are,
+     * without either kind of directory, and are searched in place too.
+     *
+     * The file is a sequence of little-endian uint64 values:
+     *
+     * - a header: the magic number, the version, the number of blocks, the
+     *   number of differing bits, the number of tables, the number of hashes
+     *   in each table, the stride, the number of directory bits, and the
+     *   encoding of the tables (0 as they are, or 1 for Elias-Fano)
+     * - the masks of each table's permutation, in order
+     * - for each table, either its prefix directory (if there are directory
+     *   bits), its sparse directory (if there's a stride) and its hashes, or
+     *   the length of its Elias-Fano encoding in words and the encoding
+     */
+    void write_index(const Index& index, const std::string& path, size_t stride = 0);
+
+    /**
+     * Whether or not the file at path starts like one written by write_index.
+     */
+    bool is_index_file(const std::string& path);
+
+    /**
+     * A read-only index backed by a file written by write_index.
+     *
+     * The file is memory-mapped and its tables are searched in place, so
+     * opening it takes no time regardless of its size, and processes that
+     * open the same file share its pages.
+     */
+    class MappedIndex {
+    public:
+        /**
+         * The version of the file format. Files of any other version are
+         * rejected.
+         */
+        static const uint64_t VERSION = 1;
+
+        /**
+         * Map the index at path, throwing std::runtime_error if it can't be
+         * read or is not a valid index.
+         */
+        explicit MappedIndex(const std::string& path);
+
+        /**
+         * Whether or not the exact hash is in the index.
+         */
+        bool contains(hash_t hash) const;
+
+        /**
+         * As with Index::find.
+         */
+        std::vector<hash_t> find(hash_t query) const;
+
+        /**
+         * As with Index::probe.
+         */
+        sorted_matches_t probe(const hash_t* queries, size_t count, size_t threads = 1) const;
+
+        /**
+         * As with Index::find_batch.
+         */
+        BatchResults find_batch(const hash_t* queries, size_t count, size_t threads = 1) const;
+
+        /**
+         * As with Index::find_batch.
+         */
+        BatchResults find_batch(const hash_t* queries, size_t count, ThreadPool& pool) const;
+
+        /**
+         * As with Index::nearest.
+         */
+        std::vector<Neighbor> nearest(hash_t query, size_t k) const;
+
+        /**
+         * As with Index::histogram.
+         */
+        std::vector<size_t> histogram(hash_t query) const;
+
+        size_t size() const;
+
+        size_t number_of_blocks() const;
+
+        size_t different_bits() const;
+
+        size_t directory_bits() const;
+
+        bool compressed() const;
+
+        const std::vector<Permutation>& permutations() const;
+
+        const std::vector<Table>& tables() const;
+
+    private:
+        MappedFile file_;
+        size_t number_of_blocks_;
+        size_t different_bits_;
+        size_t size_;
+        std::vector<Permutation> permutations_;
+        std::vector<EliasFano> compressed_;
+        std::vector<Table> tables_;
+    };
+}
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef SIMHASH_IO_H
+#define SIMHASH_IO_H
+
+#include "simhash.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Simhash {
+
+    /**
+     * The formats in which hashes may be read and results written.
+     *
+     * - FORMAT_TEXT: newline-separated decimal hashes in, JSON arrays out
+     * - FORMAT_BINARY: raw little-endian uint64 values
+     */
+    enum format_t {
+        FORMAT_TEXT,
+        FORMAT_BINARY
+    };
+
+    /**
+     * Parse the name of a format ("text" or "binary").
+     */
+    format_t parse_format(const std::string& name);
+
+    /**
+     * A read-only memory map of an entire file.
+     */
+    class MappedFile {
+    public:
+        /**
+         * Map the file at path, throwing std::runtime_error on failure,
+         * including when it isn't a regular file (such as a pipe), whose
+         * size isn't known in advance. The kernel is told to expect the file to be read sequentially, unless
+         * `sequential` is false.
+         */
+        explicit MappedFile(const std::string& path, bool sequential = true);
+
+        ~MappedFile();
+
+        const char* data() const;
+
+        size_t size() const;
+
+    private:
+        MappedFile(const MappedFile& other);
+        MappedFile& operator=(const MappedFile& other);
+
+        const char* data_;
+        size_t size_;
+    };
+
+    /**
+     * Parse whitespace-separated decimal hashes in [begin, end), appending
+     * them to hashes. Throws std::invalid_argument for anything that isn't a
+     * number and std::out_of_range for numbers that don't fit in a hash_t.
+     */
+    void parse_hashes(const char* begin, const char* end, std::vector<hash_t>& hashes);
+
+    /**
+     * Write the decimal form of hash to buffer, which must have room for 20
+     * characters. Returns a pointer to just after the last character written.
+     */
+    char* format_hash(hash_t hash, char* buffer);
+
+    /**
+     * Hashes read from a path ("-" meaning stdin) in a given format.
+     *
+     * Binary files are memory-mapped and used in place without copying. Text,
+     * and binary read from stdin or anything else that isn't a regular file,
+     * such as a pipe, are read into memory.
+     */
+    class InputHashes {
+    public:
+        InputHashes(const std::string& path, format_t format);
+
+        const hash_t* data() const;
+
+        size_t size() const;
+
+    private:
+        std::unique_ptr<MappedFile> file_;
+        std::vector<hash_t> hashes_;
+        const hash_t* data_;
+        size_t size_;
+    };
+
+    /**
+     * Accumulates output in a buffer, writing it to a stream in large chunks.
+     * Once the stream fails, nothing more is written.
+     */
+    class Writer {
+    public:
+        explicit Writer(std::ostream& stream);
+
+        /**
+         * Flushes any buffered output.
+         */
+        ~Writer();
+
+        bool good() const;
+
+        void text(const char* value, size_t length);
+
+        /**
+         * Write a hash in decimal.
+         */
+        void decimal(hash_t hash);
+
+        /**
+         * Write a hash as a little-endian uint64.
+         */
+        void binary(hash_t hash);
+
+        void flush();
+
+    private:
+        Writer(const Writer& other);
+        Writer& operator=(const Writer& other);
+
+        void reserve(size_t length);
+
+        std::ostream& stream_;
+        char buffer_[1 << 16];
+        size_t size_;
+    };
+
+    /**
+     * Write a single match, formatted as by write_matches.
+     */
+    void write_match(Writer& writer, const match_t& match, format_t format,
+                     bool distances = false);
+
+    /**
+     * Write matches to a stream. In text, each is a JSON array of two hashes
+     * on its own line; in binary, each is a pair of uint64 values.
+     *
+     * With `distances`, each match is followed by the number of bits in
+     * which its hashes differ, as a third element of the array in text, or a
+     * third uint64 in binary. Matches found with the largest distance of
+     * interest then serve every smaller one as well.
+     */
+    void write_matches(std::ostream& stream, const sorted_matches_t& matches, format_t format,
+                       bool distances = false);
+
+    /**
+     * Merge files of matches, each written in binary by write_matches in
+     * sorted order, into a single sorted stream without duplicates, writing
+     * it as write_matches would. With `distances`, the files' matches are
+     * each followed by a distance, as is every match written. Each file is
+     * memory-mapped and read once, in a k-way merge. Returns the number of
+     * matches written, and throws std::runtime_error if a file can't be read,
+     * isn't a whole number of matches, or isn't sorted.
+     */
+    size_t merge_matches(const std::vector<std::string>& paths, std::ostream& stream,
+                         format_t format, bool distances = false);
+
+    /**
+     * Write clusters to a stream. In text, each is a JSON array of hashes on
+     * its own line; in binary, each is a uint64 count followed by its hashes.
+     */
+    void write_clusters(std::ostream& stream, const clusters_t& clusters, format_t format);
+}
+
+#endif
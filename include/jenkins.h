@@ -0,0 +1,90 @@
+#ifndef SIMHASH_JENKINS_H
+#define SIMHASH_JENKINS_H
+
+#include "simhash.h"
+
+#include <cstring>
+
+namespace Simhash {
+
+    /**
+     * Bob Jenkins' lookup3 hash (hashlittle2), combining its two 32-bit
+     * results into one 64-bit hash. Input is read a word at a time, as
+     * little-endian, straight out of the provided buffer.
+     */
+    class Jenkins {
+    public:
+        explicit Jenkins(uint32_t primary = 0, uint32_t secondary = 0)
+            : primary_(primary), secondary_(secondary)
+        {}
+
+        hash_t operator()(const char* data, size_t length) const
+        {
+            uint32_t a, b, c;
+            a = b = c = 0xDEADBEEF + static_cast<uint32_t>(length) + primary_;
+            c += secondary_;
+
+            for (; length > 12; length -= 12, data += 12)
+            {
+                a += load(data);
+                b += load(data + 4);
+                c += load(data + 8);
+                mix(a, b, c);
+            }
+
+            // The last block is padded with zeros, unless there isn't one
+            if (length > 0)
+            {
+                char tail[12] = { 0 };
+                std::memcpy(tail, data, length);
+                a += load(tail);
+                b += load(tail + 4);
+                c += load(tail + 8);
+                final(a, b, c);
+            }
+            return static_cast<hash_t>(c) | (static_cast<hash_t>(b) << 32);
+        }
+
+    private:
+        static uint32_t rotate(uint32_t x, int k)
+        {
+            return (x << k) | (x >> (32 - k));
+        }
+
+        static uint32_t load(const char* data)
+        {
+            uint32_t word;
+            std::memcpy(&word, data, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            word = __builtin_bswap32(word);
+#endif
+            return word;
+        }
+
+        static void mix(uint32_t& a, uint32_t& b, uint32_t& c)
+        {
+            a -= c;  a ^= rotate(c, 4);  c += b;
+            b -= a;  b ^= rotate(a, 6);  a += c;
+            c -= b;  c ^= rotate(b, 8);  b += a;
+            a -= c;  a ^= rotate(c, 16); c += b;
+            b -= a;  b ^= rotate(a, 19); a += c;
+            c -= b;  c ^= rotate(b, 4);  b += a;
+        }
+
+        static void final(uint32_t& a, uint32_t& b, uint32_t& c)
+        {
+            c ^= b; c -= rotate(b, 14);
+            a ^= c; a -= rotate(c, 11);
+            b ^= a; b -= rotate(a, 25);
+            c ^= b; c -= rotate(b, 16);
+            a ^= c; a -= rotate(c, 4);
+            b ^= a; b -= rotate(a, 14);
+            c ^= b; c -= rotate(b, 24);
+        }
+
+        uint32_t primary_;
+        uint32_t secondary_;
+    };
+}
+
+#endif
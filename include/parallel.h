@@ -0,0 +1,237 @@
+#ifndef SIMHASH_PARALLEL_H
+#define SIMHASH_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Simhash {
+
+    /**
+     * Resolve a requested thread count; 0 means one per hardware thread.
+     */
+    inline size_t resolve_threads(size_t threads)
+    {
+        if (threads == 0)
+        {
+            threads = std::thread::hardware_concurrency();
+        }
+        return std::max(threads, static_cast<size_t>(1));
+    }
+
+    /**
+     * Call `function(i, worker)` for every `i` in [0, count), using up to
+     * `threads` threads (0 meaning one per hardware thread). Work is handed
+     * out one index at a time, and `worker` is in [0, threads) so that each
+     * thread may keep its own scratch space. The first exception thrown by
+     * any call is rethrown once all threads have finished.
+     */
+    template <typename Function>
+    void parallel_for(size_t count, size_t threads, Function function)
+    {
+        threads = std::min(resolve_threads(threads), std::max(count, static_cast<size_t>(1)));
+        if (threads == 1)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                function(i, 0);
+            }
+            return;
+        }
+
+        std::atomic<size_t> next(0);
+        std::vector<std::exception_ptr> errors(threads);
+        auto work = [&](size_t worker) {
+            try
+            {
+                for (size_t i = next++; i < count; i = next++)
+                {
+                    function(i, worker);
+                }
+            }
+            catch (...)
+            {
+                errors[worker] = std::current_exception();
+                next = count;
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (size_t worker = 1; worker < threads; ++worker)
+        {
+            pool.push_back(std::thread(work, worker));
+        }
+        work(0);
+        for (std::thread& thread : pool)
+        {
+            thread.join();
+        }
+
+        for (const std::exception_ptr& error : errors)
+        {
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    /**
+     * Threads kept waiting for work between calls, so that repeated small
+     * jobs, such as a stream of batches of queries, don't each pay to start
+     * and join threads as parallel_for does.
+     */
+    class ThreadPool {
+    public:
+        /**
+         * A pool of `threads` workers (0 meaning one per hardware thread),
+         * one of which is whichever thread calls parallel_for.
+         */
+        explicit ThreadPool(size_t threads = 0)
+            : threads_()
+            , calls_()
+            , mutex_()
+            , wake_()
+            , done_()
+            , job_()
+            , generation_(0)
+            , busy_(0)
+            , stopping_(false)
+        {
+            for (size_t worker = 1; worker < resolve_threads(threads); ++worker)
+            {
+                threads_.push_back(std::thread(&ThreadPool::run, this, worker));
+            }
+        }
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            wake_.notify_all();
+            for (std::thread& thread : threads_)
+            {
+                thread.join();
+            }
+        }
+
+        /**
+         * The number of workers, including the calling thread.
+         */
+        size_t size() const
+        {
+            return threads_.size() + 1;
+        }
+
+        /**
+         * As with the free parallel_for, with `worker` in [0, size()).
+         * Concurrent calls take turns.
+         */
+        template <typename Function>
+        void parallel_for(size_t count, Function function)
+        {
+            if (threads_.empty() || count < 2)
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    function(i, 0);
+                }
+                return;
+            }
+
+            std::lock_guard<std::mutex> call(calls_);
+            std::atomic<size_t> next(0);
+            std::vector<std::exception_ptr> errors(size());
+            auto work = [&](size_t worker) {
+                try
+                {
+                    for (size_t i = next++; i < count; i = next++)
+                    {
+                        function(i, worker);
+                    }
+                }
+                catch (...)
+                {
+                    errors[worker] = std::current_exception();
+                    next = count;
+                }
+            };
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                job_ = work;
+                busy_ = threads_.size();
+                ++generation_;
+            }
+            wake_.notify_all();
+            work(0);
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                done_.wait(lock, [this]() { return busy_ == 0; });
+                job_ = nullptr;
+            }
+
+            for (const std::exception_ptr& error : errors)
+            {
+                if (error)
+                {
+                    std::rethrow_exception(error);
+                }
+            }
+        }
+
+    private:
+        ThreadPool(const ThreadPool& other);
+        ThreadPool& operator=(const ThreadPool& other);
+
+        /* Each worker waits for a new job, does its share, and reports back. */
+        void run(size_t worker)
+        {
+            size_t seen(0);
+            while (true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    wake_.wait(lock, [this, seen]() { return stopping_ || generation_ != seen; });
+                    if (stopping_)
+                    {
+                        return;
+                    }
+                    seen = generation_;
+                }
+                job_(worker);
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (--busy_ == 0)
+                    {
+                        done_.notify_one();
+                    }
+                }
+            }
+        }
+
+        std::vector<std::thread> threads_;
+
+        /* Held for the whole of a call to parallel_for. */
+        std::mutex calls_;
+
+        /* Guards the job and the counts, signalling workers to start and
+         * the caller once they've all finished. */
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable done_;
+        std::function<void(size_t)> job_;
+        size_t generation_;
+        size_t busy_;
+        bool stopping_;
+    };
+}
+
+#endif
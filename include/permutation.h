@@ -3,10 +3,57 @@
 
 #include "simhash.h"
 
+#include <array>
+#include <stdint.h>
 #include <vector>
 
 namespace Simhash {
-    
+
+    /**
+     * Lazily generates the combinations of r of the indices [0, n), in
+     * lexicographic order, one at a time:
+     *
+     *     for (Combinations combination(n, r); !combination.done(); combination.next())
+     *
+     * Its state is a fixed array, so that generating them allocates nothing.
+     */
+    class Combinations {
+    public:
+        /**
+         * Start at the first combination, or at the one with the given rank
+         * in lexicographic order (which must be less than count(n, r)).
+         */
+        Combinations(size_t n, size_t r, size_t rank = 0);
+
+        /**
+         * The number of combinations of r of n, which must fit in 64 bits.
+         */
+        static size_t count(size_t n, size_t r);
+
+        /**
+         * Whether every combination has been generated.
+         */
+        bool done() const;
+
+        /**
+         * Move on to the next combination.
+         */
+        void next();
+
+        /**
+         * The current combination's indices, in ascending order.
+         */
+        const uint8_t* indices() const;
+
+        size_t size() const;
+
+    private:
+        size_t n_;
+        size_t r_;
+        bool done_;
+        std::array<uint8_t, BITS> indices_;
+    };
+
     class Permutation {
     public:
         /**
@@ -16,6 +63,18 @@ namespace Simhash {
         static std::vector<Permutation> create(size_t number_of_blocks,
                                                size_t different_bits);
 
+        /**
+         * The number of permutations create() would produce.
+         */
+        static size_t count(size_t number_of_blocks, size_t different_bits);
+
+        /**
+         * Create only the i'th of the permutations create() would produce,
+         * so that tables may be built and processed one at a time without
+         * holding every permutation.
+         */
+        static Permutation nth(size_t number_of_blocks, size_t different_bits, size_t i);
+
         /**
          * Generate combinations of length r from population.
          */
@@ -26,7 +85,12 @@ namespace Simhash {
          * Construct a permutation from its permutation masks and the maximum
          * number of bits that may differ.
          */
-        Permutation(size_t different_bits, std::vector<hash_t>& masks);
+        Permutation(size_t different_bits, const std::vector<hash_t>& masks);
+
+        /**
+         * Construct a permutation from `count` masks.
+         */
+        Permutation(size_t different_bits, const hash_t* masks, size_t count);
 
         /**
          * Apply this permutation.
@@ -38,6 +102,13 @@ namespace Simhash {
          */
         hash_t reverse(hash_t hash) const;
 
+        /**
+         * Apply this permutation to `count` hashes from `input`, writing them
+         * to `output` (which may be the same as `input`). This uses AVX2 or
+         * AVX-512 when available.
+         */
+        void apply_many(const hash_t* input, hash_t* output, size_t count) const;
+
         /**
          * Search mask
          *
@@ -49,11 +120,46 @@ namespace Simhash {
          * searched is the query with all the bits in the last
          * _differing_bits_ blocks set to 1. */
         hash_t search_mask() const;
+
+        /**
+         * Whether this permutation owns the match between two (unpermuted)
+         * hashes: whether, among the permutations produced by create(), this
+         * is the first in which they share a prefix.
+         *
+         * Every pair of hashes that shares a prefix in any table is owned by
+         * exactly one, so matches may be emitted only by their owner to avoid
+         * duplicates without having to remember them.
+         */
+        bool owns(hash_t a, hash_t b) const;
+
+        /**
+         * The masks from which this permutation was constructed.
+         */
+        std::vector<hash_t> masks() const;
+
+        /**
+         * How a block is moved: it's masked, and then shifted left and right.
+         * At most one of the shifts is non-zero, but doing both avoids
+         * branching on the direction.
+         */
+        struct Block
+        {
+            hash_t forward_mask;
+            hash_t reverse_mask;
+            uint8_t left_shift;
+            uint8_t right_shift;
+        };
     private:
-        std::vector<hash_t> forward_masks;
-        std::vector<hash_t> reverse_masks;
-        std::vector<int> offsets;
+        /* The permutation of create() whose prefix is the combination. */
+        static Permutation from_combination(
+            size_t number_of_blocks, size_t different_bits, const Combinations& combination);
+
+        /* One entry per block, so that copies of a permutation are no bigger
+         * than its number of blocks requires. */
+        std::vector<Block> blocks;
+        size_t prefix_blocks;
         hash_t search_mask_;
+        hash_t highest_prefix_mask;
     };
 }
 
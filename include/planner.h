@@ -0,0 +1,77 @@
+#ifndef SIMHASH_PLANNER_H
+#define SIMHASH_PLANNER_H
+
+#include <string>
+
+#include "simhash.h"
+
+namespace Simhash {
+
+    /**
+     * The estimated cost of finding all matches among some hashes with one
+     * choice of blocks.
+     */
+    struct Plan
+    {
+        size_t number_of_blocks;
+        size_t different_bits;
+
+        /* The number of permutation tables. */
+        size_t tables;
+
+        /* The number of pairs of hashes sharing a prefix, summed over every
+         * table, each of which must be compared. */
+        double comparisons;
+
+        /* The memory needed to hold every table at once, as an Index does,
+         * in bytes. find_all holds only one table per thread. */
+        size_t memory;
+
+        /* The estimated time taken by find_all on one thread, in seconds. */
+        double seconds;
+    };
+
+    /**
+     * The number of hashes sampled by default to estimate a plan.
+     */
+    const size_t PLAN_SAMPLE_SIZE = 8192;
+
+    /**
+     * Estimate the cost of finding all matches among `count` hashes, which
+     * may contain duplicates, with the given blocks and distance.
+     *
+     * Every table costs time for each hash, to permute, sort and scan it, and
+     * every pair of hashes sharing a table's prefix costs a comparison. The
+     * pairs are counted in an evenly-spaced sample of `sample_size` of the
+     * hashes, across a few of the tables, and scaled up; hashes that are
+     * clustered rather than uniform share prefixes more often than their
+     * widths alone would suggest. Throws std::invalid_argument under the same
+     * conditions as Permutation::create.
+     */
+    Plan estimate_plan(const hash_t* hashes,
+                       size_t count,
+                       size_t number_of_blocks,
+                       size_t different_bits,
+                       size_t sample_size = PLAN_SAMPLE_SIZE);
+
+    /**
+     * Estimate every number of blocks able to find matches within
+     * `different_bits`, and return the plan estimated to be fastest. If
+     * `memory_budget` is nonzero, only plans whose tables would fit in it are
+     * considered, unless none do, in which case the one with the fewest
+     * tables is returned.
+     */
+    Plan choose_plan(const hash_t* hashes,
+                     size_t count,
+                     size_t different_bits,
+                     size_t memory_budget = 0,
+                     size_t sample_size = PLAN_SAMPLE_SIZE);
+
+    /**
+     * A one-line summary of a plan for reporting, such as "6 blocks: 20
+     * tables, about 5000 comparisons and 0.01s".
+     */
+    std::string describe_plan(const Plan& plan);
+}
+
+#endif
@@ -34,6 +34,11 @@ namespace Simhash {
      */
     typedef std::unordered_set<match_t, match_t_hash> matches_t;
 
+    /**
+     * Matches as a flat vector, sorted and without duplicates.
+     */
+    typedef std::vector<match_t> sorted_matches_t;
+
     /**
      * The type of a set of clusters.
      */
@@ -52,32 +57,202 @@ namespace Simhash {
      * @param b - number to compare
      *
      * @return number of bits that differ between a and b */
-    size_t num_differing_bits(hash_t a, hash_t b);
+    inline size_t num_differing_bits(hash_t a, hash_t b)
+    {
+        return static_cast<size_t>(__builtin_popcountll(a ^ b));
+    }
+
+    /**
+     * Find the candidates within `different_bits` of the query.
+     *
+     * This compares the query against a contiguous block of candidates at a
+     * time, using AVX-512 or AVX2 when available.
+     *
+     * @param query - reference number
+     * @param candidates - numbers to compare
+     * @param count - number of candidates
+     * @param different_bits - maximum number of bits that may differ
+     * @param indices - receives the index of each matching candidate, in
+     *                  order; must have room for `count` indices
+     *
+     * @return number of matching candidates */
+    size_t find_within(hash_t query,
+                       const hash_t* candidates,
+                       size_t count,
+                       size_t different_bits,
+                       size_t* indices);
+
+    /**
+     * Accumulates the bit counts of a stream of hashes, for computing a
+     * simhash without first collecting all of them.
+     */
+    class Accumulator {
+    public:
+        Accumulator();
+
+        /**
+         * Add `count` contiguous hashes. Bits are counted with AVX-512 or
+         * AVX2 when available, so adding hashes in batches is cheaper than
+         * adding them one at a time.
+         */
+        void add(const hash_t* hashes, size_t count);
+
+        /**
+         * The simhash of all the hashes added so far.
+         */
+        hash_t result() const;
+
+    private:
+        uint64_t ones_[BITS];
+        size_t count_;
+    };
 
     /**
      * Compute the simhash of a vector of hashes.
      */
     hash_t compute(const std::vector<hash_t>& hashes);
 
+    /**
+     * Compute the simhash of `count` contiguous hashes. Bits are counted with
+     * AVX-512 or AVX2 when available, and nothing is allocated.
+     */
+    hash_t compute(const hash_t* hashes, size_t count);
+
+    /**
+     * Compute the simhash of `count` contiguous hashes, where each hash
+     * contributes its weight, rather than 1, to the count of each bit.
+     */
+    hash_t compute(const hash_t* hashes, const int32_t* weights, size_t count);
+
+    /**
+     * Compute the simhashes of `count` documents at once, writing them to
+     * `results`. The hashes of document `i` are hashes[offsets[i]] up to
+     * hashes[offsets[i + 1]], so `offsets` holds `count + 1` entries. If
+     * `weights` is non-null, it holds the weight of each hash.
+     *
+     * Documents are divided between up to `threads` threads (0 meaning one
+     * per hardware thread).
+     */
+    void compute_many(const hash_t* hashes,
+                      const int32_t* weights,
+                      const size_t* offsets,
+                      size_t count,
+                      hash_t* results,
+                      size_t threads = 1);
+
     /**
      * Find the set of all matches within the provided vector of hashes.
      *
      * The provided hashes are manipulated in place, but upon completion are
      * restored to their original state.
+     *
+     * Permutation tables are processed on up to `threads` threads (0 meaning
+     * one per hardware thread).
      */
     matches_t find_all(std::unordered_set<hash_t>& hashes,
                        size_t number_of_blocks,
-                       size_t different_bits);
+                       size_t different_bits,
+                       size_t threads = 1);
+
+    /**
+     * Find the set of all matches within `count` contiguous hashes, which may
+     * contain duplicates.
+     *
+     * Rather than requiring a set, the hashes are copied once and deduplicated
+     * with a sort.
+     */
+    matches_t find_all(const hash_t* hashes,
+                       size_t count,
+                       size_t number_of_blocks,
+                       size_t different_bits,
+                       size_t threads = 1);
+
+    /**
+     * Find the set of all matches within the provided hashes, like `find_all`,
+     * but returned as a sorted vector.
+     *
+     * Rather than inserting each match into a hash set, matches are appended to
+     * flat buffers which are sorted and deduplicated. This avoids an allocation
+     * per match and uses considerably less memory for large numbers of matches.
+     */
+    sorted_matches_t find_all_sorted(std::unordered_set<hash_t>& hashes,
+                                     size_t number_of_blocks,
+                                     size_t different_bits,
+                                     size_t threads = 1);
+
+    /**
+     * Find all matches within `count` contiguous hashes, which may contain
+     * duplicates, as a sorted vector.
+     */
+    sorted_matches_t find_all_sorted(const hash_t* hashes,
+                                     size_t count,
+                                     size_t number_of_blocks,
+                                     size_t different_bits,
+                                     size_t threads = 1);
+
+    /**
+     * Find all matches within a vector of hashes, which may contain
+     * duplicates, as a sorted vector.
+     *
+     * The provided hashes are sorted and deduplicated in place, and then used
+     * directly, avoiding a copy.
+     */
+    sorted_matches_t find_all_sorted(std::vector<hash_t>& hashes,
+                                     size_t number_of_blocks,
+                                     size_t different_bits,
+                                     size_t threads = 1);
+
+    /**
+     * Find one shard of the matches within `count` contiguous hashes, which
+     * may contain duplicates, as a sorted vector, so that the work may be
+     * split among processes or machines.
+     *
+     * Shard `shard` of `shards` scans the permutation tables whose positions
+     * are `shard` modulo `shards`, and keeps only the matches those tables own
+     * (see Permutation::owns). Every match is owned by exactly one table, so
+     * the shards' matches are disjoint, and merged together they're exactly
+     * those of find_all_sorted. Throws std::invalid_argument unless shard is
+     * less than shards.
+     */
+    sorted_matches_t find_all_sorted_shard(const hash_t* hashes,
+                                           size_t count,
+                                           size_t number_of_blocks,
+                                           size_t different_bits,
+                                           size_t shard,
+                                           size_t shards,
+                                           size_t threads = 1);
 
     /**
      * Find all the clusters of simhashes.
      *
      * For a simhash to be added to a cluster, there must be a member in the
      * cluster already that is within `number_of_blocks` of the hash.
+     *
+     * Matches are merged into a union-find as the tables are scanned by up to
+     * `threads` threads, rather than collected first, so memory use grows
+     * with the number of hashes rather than the number of matches. Hashes
+     * without any matches are not part of any cluster.
+     *
+     * Since only connectivity matters, a hash is no longer compared with
+     * those sharing a prefix with it once it's known to be in their cluster,
+     * so a prefix shared by many near-duplicates costs time in proportion to
+     * their number rather than to the number of pairs among them. Exact
+     * duplicates are removed first.
      */
     clusters_t find_clusters(std::unordered_set<hash_t>& hashes,
                              size_t number_of_blocks,
-                             size_t different_bits);
+                             size_t different_bits,
+                             size_t threads = 1);
+
+    /**
+     * Find all the clusters within `count` contiguous hashes, which may
+     * contain duplicates.
+     */
+    clusters_t find_clusters(const hash_t* hashes,
+                             size_t count,
+                             size_t number_of_blocks,
+                             size_t different_bits,
+                             size_t threads = 1);
 }
 
 #endif
@@ -0,0 +1,25 @@
+#ifndef SIMHASH_SORT_H
+#define SIMHASH_SORT_H
+
+#include "simhash.h"
+
+namespace Simhash {
+
+    /**
+     * Sort hashes in place with a radix sort, using `scratch` (which must have
+     * room for `count` hashes) as a buffer.
+     *
+     * Only the leading `bits` bits are guaranteed to be in order, which is all
+     * that is needed to group hashes by a search mask prefix; hashes that share
+     * those bits may end up in any order. Large inputs are first partitioned
+     * by their leading byte, and then each partition is sorted independently;
+     * with more than one thread, both of these steps are done in parallel.
+     */
+    void radix_sort(hash_t* hashes,
+                    hash_t* scratch,
+                    size_t count,
+                    size_t bits = BITS,
+                    size_t threads = 1);
+}
+
+#endif
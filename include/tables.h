@@ -0,0 +1,163 @@
+#ifndef SIMHASH_TABLES_H
+#define SIMHASH_TABLES_H
+
+#include "simhash.h"
+#include "elias_fano.h"
+#include "parallel.h"
+#include "permutation.h"
+
+#include <utility>
+#include <vector>
+
+namespace Simhash {
+
+    /**
+     * A read-only view of a table: hashes with a permutation applied, in
+     * sorted order, stored elsewhere (in an Index or a mapped file). The
+     * hashes are either stored as they are, in `data`, or encoded in
+     * `compressed`, in which case `data` is null.
+     */
+    struct Table {
+        const hash_t* data;
+        size_t size;
+
+        /* Optionally, every stride'th hash of the table, so that searches may
+         * first narrow down which stride to look in. This keeps the search of
+         * a large mapped table to a couple of pages. */
+        const hash_t* samples;
+        size_t stride;
+
+        /* Optionally, for each value p of the leading `directory_bits` bits,
+         * the hashes starting with p are [directory[p], directory[p + 1]).
+         * A search then reads one entry of the directory and searches only
+         * the range it gives. */
+        const uint64_t* directory;
+        size_t directory_bits;
+
+        const EliasFano* compressed;
+
+        /**
+         * The first hash in the table not less than value. Only for tables
+         * that aren't compressed.
+         */
+        const hash_t* lower_bound(hash_t value) const;
+
+        /**
+         * The first hash in the table greater than value. Only for tables
+         * that aren't compressed.
+         */
+        const hash_t* upper_bound(hash_t value) const;
+
+        /**
+         * The hashes in [low, high], and how many there are. They're read in
+         * place unless the table is compressed, in which case they're decoded
+         * into scratch.
+         */
+        std::pair<const hash_t*, size_t> range(
+            hash_t low, hash_t high, std::vector<hash_t>& scratch) const;
+    };
+
+    /**
+     * The neighbors of each of a batch of queries, in compressed sparse row
+     * form: those of the i'th query are neighbors[offsets[i]] up to
+     * neighbors[offsets[i + 1]], in ascending order.
+     */
+    struct BatchResults {
+        std::vector<size_t> offsets;
+        std::vector<hash_t> neighbors;
+    };
+
+    /**
+     * A stored hash and its distance from a query. Neighbors are ordered by
+     * distance, and then by hash.
+     */
+    struct Neighbor {
+        hash_t hash;
+        size_t distance;
+
+        bool operator<(const Neighbor& other) const
+        {
+            return distance != other.distance ? distance < other.distance : hash < other.hash;
+        }
+
+        bool operator==(const Neighbor& other) const
+        {
+            return hash == other.hash && distance == other.distance;
+        }
+    };
+
+    /**
+     * The largest supported number of directory bits.
+     */
+    const size_t MAX_DIRECTORY_BITS = 24;
+
+    /**
+     * The number of entries in a directory of the leading `bits` bits.
+     */
+    inline size_t directory_size(size_t bits)
+    {
+        return (static_cast<size_t>(1) << bits) + 1;
+    }
+
+    /**
+     * Fill in the directory of the leading `bits` bits of `size` sorted
+     * hashes, which must have room for directory_size(bits) entries.
+     */
+    void build_directory(const hash_t* data, size_t size, size_t bits, uint64_t* directory);
+
+    /**
+     * Find all the hashes in the tables within `different_bits` of the
+     * query, unpermuted and in ascending order. Each table must have been
+     * sorted after applying the corresponding permutation.
+     */
+    std::vector<hash_t> find_in_tables(const std::vector<Permutation>& permutations,
+                                       const std::vector<Table>& tables,
+                                       size_t different_bits,
+                                       hash_t query);
+
+    /**
+     * Find the k hashes in the tables nearest the query, as described by
+     * Index::nearest. The tables must be those of the permutations create()
+     * makes for `number_of_blocks` and `different_bits`, in the same order.
+     */
+    std::vector<Neighbor> nearest_in_tables(const std::vector<Permutation>& permutations,
+                                            const std::vector<Table>& tables,
+                                            size_t number_of_blocks,
+                                            size_t different_bits,
+                                            hash_t query,
+                                            size_t k);
+
+    /**
+     * Count the hashes in the tables at each distance from the query, as
+     * described by Index::histogram. The tables must be those of the
+     * permutations create() makes, in the same order.
+     */
+    std::vector<size_t> histogram_in_tables(const std::vector<Permutation>& permutations,
+                                            const std::vector<Table>& tables,
+                                            size_t different_bits,
+                                            hash_t query);
+
+    /**
+     * Find all the pairs within `different_bits` among the queries, or
+     * between a query and a hash in the tables, as described by Index::probe.
+     */
+    sorted_matches_t probe_tables(const std::vector<Permutation>& permutations,
+                                  const std::vector<Table>& tables,
+                                  size_t different_bits,
+                                  const hash_t* queries,
+                                  size_t count,
+                                  size_t threads);
+
+    /**
+     * Find the neighbors of each of the queries, as described by
+     * Index::find_batch, on the workers of the pool.
+     */
+    BatchResults find_batch_in_tables(const std::vector<Permutation>& permutations,
+                                      const std::vector<Table>& tables,
+                                      size_t different_bits,
+                                      const hash_t* queries,
+                                      size_t count,
+                                      ThreadPool& pool);
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef SIMHASH_TOKENIZER_H
+#define SIMHASH_TOKENIZER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <stdint.h>
+
+namespace Simhash {
+
+    /**
+     * For each block of 64 bytes in [data, data + length), set the bits of
+     * masks[block] that correspond to ASCII letters. Bits past the end of the
+     * data are clear. Uses AVX-512 or AVX2 when available.
+     */
+    void alpha_masks(const char* data, size_t length, uint64_t* masks);
+
+    /**
+     * Splits text into runs of ASCII letters, discarding everything else.
+     *
+     * Tokenizers call `emit(token, length)` for each token in order, where
+     * `token` points into the provided buffer, so nothing is copied.
+     */
+    class AlphaTokenizer {
+    public:
+        template <typename Emit>
+        void operator()(const char* data, size_t length, Emit emit) const
+        {
+            /* Letters are found 64 bytes at a time, and the token boundaries
+             * are then the bits that differ from the bit before them. */
+            const size_t chunk = 1024;
+            uint64_t masks[chunk / 64];
+            const char* token(nullptr);
+            for (size_t offset = 0; offset < length; offset += chunk)
+            {
+                size_t size = std::min(chunk, length - offset);
+                alpha_masks(data + offset, size, masks);
+                for (size_t block = 0; block * 64 < size; ++block)
+                {
+                    const char* base = data + offset + block * 64;
+                    uint64_t mask = masks[block];
+                    uint64_t boundaries = mask ^ ((mask << 1) | (token ? 1 : 0));
+                    for (; boundaries; boundaries &= boundaries - 1)
+                    {
+                        const char* position = base + __builtin_ctzll(boundaries);
+                        if (token)
+                        {
+                            emit(token, static_cast<size_t>(position - token));
+                            token = nullptr;
+                        }
+                        else
+                        {
+                            token = position;
+                        }
+                    }
+                }
+            }
+
+            if (token)
+            {
+                emit(token, static_cast<size_t>(data + length - token));
+            }
+        }
+    };
+}
+
+#endif
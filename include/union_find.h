@@ -0,0 +1,50 @@
+#ifndef SIMHASH_UNION_FIND_H
+#define SIMHASH_UNION_FIND_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace Simhash {
+
+    /**
+     * Disjoint sets over the dense indices [0, size), each starting out on its
+     * own. Every operation is lock-free, so `unite` may be called from many
+     * threads at once; each set is always rooted at its smallest index, which
+     * makes the final sets independent of the order of the calls.
+     */
+    class UnionFind {
+    public:
+        explicit UnionFind(size_t size);
+
+        /**
+         * The root of the set containing `index`. Each node on the way is
+         * pointed at its grandparent, so that later finds are cheaper.
+         */
+        size_t find(size_t index);
+
+        /**
+         * Merge the sets containing `a` and `b`. Returns false if they were
+         * already the same set.
+         */
+        bool unite(size_t a, size_t b);
+
+        /**
+         * Whether or not `a` and `b` are in the same set.
+         */
+        bool same(size_t a, size_t b);
+
+        /**
+         * The number of indices.
+         */
+        size_t size() const;
+
+    private:
+        UnionFind(const UnionFind& other);
+        UnionFind& operator=(const UnionFind& other);
+
+        std::vector<std::atomic<size_t> > parents_;
+    };
+}
+
+#endif
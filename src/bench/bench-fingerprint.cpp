@@ -0,0 +1,65 @@
+#include <random>
+#include <string>
+
+#include "bench.h"
+#include "fingerprint.h"
+
+namespace {
+
+    /**
+     * About `size` bytes of text made of random lower-case words.
+     */
+    std::string random_text(size_t size)
+    {
+        std::mt19937_64 generator(42);
+        std::string text;
+        text.reserve(size + 16);
+        while (text.size() < size)
+        {
+            for (size_t length = 1 + generator() % 10; length > 0; --length)
+            {
+                text.push_back('a' + generator() % 26);
+            }
+            text.push_back(generator() % 8 ? ' ' : '.');
+        }
+        return text;
+    }
+}
+
+static void BM_Jenkins(benchmark::State& state)
+{
+    std::string text = random_text(state.range(0));
+    Simhash::Jenkins jenkins;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(jenkins(text.data(), text.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_Jenkins)->Arg(8)->Arg(64)->Arg(1 << 16);
+
+static void BM_Tokenize(benchmark::State& state)
+{
+    std::string text = random_text(state.range(0));
+    Simhash::AlphaTokenizer tokenizer;
+    for (auto _ : state)
+    {
+        size_t tokens(0);
+        tokenizer(text.data(), text.size(), [&tokens](const char*, size_t) { ++tokens; });
+        benchmark::DoNotOptimize(tokens);
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_Tokenize)->Arg(1 << 16);
+
+static void BM_Fingerprint(benchmark::State& state)
+{
+    std::string text = random_text(state.range(0));
+    Simhash::Fingerprinter<> fingerprinter;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(fingerprinter(text.data(), text.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_Fingerprint)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <vector>
+
+#include "bench.h"
+#include "index.h"
+
+namespace {
+
+    /**
+     * Sweep index size and the number of directory bits, passed as range(0)
+     * and range(1). A directory of -1 bits stands for compressed tables.
+     */
+    void index_arguments(benchmark::internal::Benchmark* benchmark)
+    {
+        benchmark->ArgNames({ "hashes", "directory" });
+        for (long hashes : { 1 << 14, 1 << 20 })
+        {
+            for (long directory : { -1, 0, 8, 16 })
+            {
+                benchmark->Args({ hashes, directory });
+            }
+        }
+    }
+
+    /**
+     * An index of `count` hashes, with the tables either given a directory
+     * of `directory` bits or, if that's negative, compressed.
+     */
+    Simhash::Index build(size_t count, long directory)
+    {
+        const size_t* configuration = Bench::CONFIGURATIONS[0];
+        std::vector<Simhash::hash_t> hashes = Bench::corpus(count, 10, configuration[1]);
+        Simhash::Index index(configuration[0], configuration[1], std::max(directory, 0L));
+        index.insert(hashes);
+        if (directory < 0)
+        {
+            index.compress();
+        }
+        return index;
+    }
+
+    void label_index(benchmark::State& state, const Simhash::Index& index)
+    {
+        Bench::label_configuration(state, 0);
+        state.counters["directory_bytes"] = index.directory_bytes();
+        state.counters["table_bytes"] = index.table_bytes();
+    }
+}
+
+static void BM_IndexFind(benchmark::State& state)
+{
+    Simhash::Index index = build(state.range(0), state.range(1));
+
+    std::vector<Simhash::hash_t> queries = Bench::random_hashes(1024);
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(index.find(queries[i++ % queries.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+    label_index(state, index);
+}
+BENCHMARK(BM_IndexFind)->Apply(index_arguments);
+
+static void BM_IndexProbe(benchmark::State& state)
+{
+    Simhash::Index index = build(state.range(0), state.range(1));
+
+    std::vector<Simhash::hash_t> queries = Bench::random_hashes(1 << 12);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(index.probe(queries.data(), queries.size()));
+    }
+    state.SetItemsProcessed(state.iterations() * queries.size());
+    label_index(state, index);
+}
+BENCHMARK(BM_IndexProbe)->Apply(index_arguments)->Unit(benchmark::kMillisecond);
+
+static void BM_IndexFindBatch(benchmark::State& state)
+{
+    Simhash::Index index = build(state.range(0), state.range(1));
+
+    std::vector<Simhash::hash_t> queries = Bench::random_hashes(1 << 12);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(index.find_batch(queries.data(), queries.size()));
+    }
+    state.SetItemsProcessed(state.iterations() * queries.size());
+    label_index(state, index);
+}
+BENCHMARK(BM_IndexFindBatch)->Apply(index_arguments)->Unit(benchmark::kMillisecond);
+
+static void BM_IndexNearest(benchmark::State& state)
+{
+    const size_t* configuration = Bench::CONFIGURATIONS[0];
+    std::vector<Simhash::hash_t> hashes = Bench::corpus(state.range(0), 10, configuration[1]);
+    Simhash::Index index(configuration[0], configuration[1]);
+    index.insert(hashes);
+
+    // Stored hashes are their own nearest neighbors, and many have
+    // near-duplicates, so the search may stop early
+    std::vector<Simhash::hash_t> queries(hashes.begin(), hashes.begin() + 1024);
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(index.nearest(queries[i++ % queries.size()], state.range(1)));
+    }
+    state.SetItemsProcessed(state.iterations());
+    Bench::label_configuration(state, 0);
+}
+BENCHMARK(BM_IndexNearest)
+    ->ArgNames({ "hashes", "k" })
+    ->ArgsProduct({ { 1 << 14, 1 << 20 }, { 1, 10, 1000 } });
@@ -0,0 +1,81 @@
+#include <vector>
+
+#include "bench.h"
+#include "permutation.h"
+
+namespace {
+
+    void configuration_arguments(benchmark::internal::Benchmark* benchmark)
+    {
+        benchmark->ArgName("configuration")->DenseRange(0, 2);
+    }
+}
+
+static void BM_Create(benchmark::State& state)
+{
+    const size_t* configuration = Bench::CONFIGURATIONS[state.range(0)];
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(
+            Simhash::Permutation::create(configuration[0], configuration[1]));
+    }
+    Bench::label_configuration(state, state.range(0));
+}
+BENCHMARK(BM_Create)->Apply(configuration_arguments);
+
+static void BM_Apply(benchmark::State& state)
+{
+    const size_t* configuration = Bench::CONFIGURATIONS[state.range(0)];
+    Simhash::Permutation permutation =
+        Simhash::Permutation::create(configuration[0], configuration[1]).back();
+    std::vector<Simhash::hash_t> hashes = Bench::random_hashes(4096);
+    for (auto _ : state)
+    {
+        Simhash::hash_t total(0);
+        for (Simhash::hash_t hash : hashes)
+        {
+            total ^= permutation.apply(hash);
+        }
+        benchmark::DoNotOptimize(total);
+    }
+    Bench::label_configuration(state, state.range(0));
+    state.SetItemsProcessed(state.iterations() * hashes.size());
+}
+BENCHMARK(BM_Apply)->Apply(configuration_arguments);
+
+static void BM_Reverse(benchmark::State& state)
+{
+    const size_t* configuration = Bench::CONFIGURATIONS[state.range(0)];
+    Simhash::Permutation permutation =
+        Simhash::Permutation::create(configuration[0], configuration[1]).back();
+    std::vector<Simhash::hash_t> hashes = Bench::random_hashes(4096);
+    for (auto _ : state)
+    {
+        Simhash::hash_t total(0);
+        for (Simhash::hash_t hash : hashes)
+        {
+            total ^= permutation.reverse(hash);
+        }
+        benchmark::DoNotOptimize(total);
+    }
+    Bench::label_configuration(state, state.range(0));
+    state.SetItemsProcessed(state.iterations() * hashes.size());
+}
+BENCHMARK(BM_Reverse)->Apply(configuration_arguments);
+
+static void BM_ApplyMany(benchmark::State& state)
+{
+    const size_t* configuration = Bench::CONFIGURATIONS[state.range(0)];
+    Simhash::Permutation permutation =
+        Simhash::Permutation::create(configuration[0], configuration[1]).back();
+    std::vector<Simhash::hash_t> hashes = Bench::random_hashes(4096);
+    std::vector<Simhash::hash_t> permuted(hashes.size());
+    for (auto _ : state)
+    {
+        permutation.apply_many(hashes.data(), permuted.data(), hashes.size());
+        benchmark::ClobberMemory();
+    }
+    Bench::label_configuration(state, state.range(0));
+    state.SetItemsProcessed(state.iterations() * hashes.size());
+}
+BENCHMARK(BM_ApplyMany)->Apply(configuration_arguments);
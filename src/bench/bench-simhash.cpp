@@ -0,0 +1,114 @@
+#include <vector>
+
+#include "bench.h"
+#include "simhash.h"
+
+static void BM_Compute(benchmark::State& state)
+{
+    std::vector<Simhash::hash_t> hashes = Bench::random_hashes(state.range(0));
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(Simhash::compute(hashes));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Compute)->RangeMultiplier(8)->Range(8, 1 << 15);
+
+static void BM_ComputeWeighted(benchmark::State& state)
+{
+    std::vector<Simhash::hash_t> hashes = Bench::random_hashes(state.range(0));
+    std::vector<int32_t> weights(hashes.size());
+    for (size_t i = 0; i < weights.size(); ++i)
+    {
+        weights[i] = static_cast<int32_t>(hashes[i] % 100);
+    }
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(
+            Simhash::compute(hashes.data(), weights.data(), hashes.size()));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ComputeWeighted)->RangeMultiplier(8)->Range(8, 1 << 15);
+
+// Many documents of 256 hashes each
+static void BM_ComputeMany(benchmark::State& state)
+{
+    const size_t size = 256;
+    std::vector<Simhash::hash_t> hashes = Bench::random_hashes(state.range(0) * size);
+    std::vector<size_t> offsets;
+    for (size_t i = 0; i <= static_cast<size_t>(state.range(0)); ++i)
+    {
+        offsets.push_back(i * size);
+    }
+    std::vector<Simhash::hash_t> results(state.range(0));
+    for (auto _ : state)
+    {
+        Simhash::compute_many(
+            hashes.data(), nullptr, offsets.data(), results.size(), results.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ComputeMany)->Arg(1 << 12)->Arg(1 << 15)->Unit(benchmark::kMillisecond);
+
+static void BM_NumDifferingBits(benchmark::State& state)
+{
+    std::vector<Simhash::hash_t> hashes = Bench::random_hashes(4096);
+    for (auto _ : state)
+    {
+        size_t total(0);
+        for (size_t i = 1; i < hashes.size(); ++i)
+        {
+            total += Simhash::num_differing_bits(hashes[i - 1], hashes[i]);
+        }
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(state.iterations() * 4095);
+}
+BENCHMARK(BM_NumDifferingBits);
+
+static void BM_FindAll(benchmark::State& state)
+{
+    const size_t* configuration = Bench::CONFIGURATIONS[state.range(1)];
+    std::vector<Simhash::hash_t> hashes = Bench::corpus(
+        state.range(0), state.range(2), configuration[1]);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(Simhash::find_all(
+            hashes.data(), hashes.size(), configuration[0], configuration[1]));
+    }
+    Bench::label_configuration(state, state.range(1));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FindAll)->Apply(Bench::corpus_arguments);
+
+static void BM_FindAllSorted(benchmark::State& state)
+{
+    const size_t* configuration = Bench::CONFIGURATIONS[state.range(1)];
+    std::vector<Simhash::hash_t> hashes = Bench::corpus(
+        state.range(0), state.range(2), configuration[1]);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(Simhash::find_all_sorted(
+            hashes.data(), hashes.size(), configuration[0], configuration[1]));
+    }
+    Bench::label_configuration(state, state.range(1));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FindAllSorted)->Apply(Bench::corpus_arguments);
+
+static void BM_FindClusters(benchmark::State& state)
+{
+    const size_t* configuration = Bench::CONFIGURATIONS[state.range(1)];
+    std::vector<Simhash::hash_t> hashes = Bench::corpus(
+        state.range(0), state.range(2), configuration[1]);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(Simhash::find_clusters(
+            hashes.data(), hashes.size(), configuration[0], configuration[1]));
+    }
+    Bench::label_configuration(state, state.range(1));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FindClusters)->Apply(Bench::corpus_arguments);
@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <vector>
+
+#include "bench.h"
+#include "sort.h"
+
+using Bench::random_hashes;
+
+namespace {
+
+    void sort_arguments(benchmark::internal::Benchmark* benchmark)
+    {
+        benchmark->Arg(1000000)->Arg(10000000)->Arg(100000000);
+        benchmark->Unit(benchmark::kMillisecond);
+    }
+}
+
+static void BM_StdSort(benchmark::State& state)
+{
+    std::vector<Simhash::hash_t> hashes = random_hashes(state.range(0));
+    std::vector<Simhash::hash_t> copy(hashes.size());
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::copy(hashes.begin(), hashes.end(), copy.begin());
+        state.ResumeTiming();
+        std::sort(copy.begin(), copy.end());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_StdSort)->Apply(sort_arguments);
+
+static void BM_RadixSort(benchmark::State& state)
+{
+    std::vector<Simhash::hash_t> hashes = random_hashes(state.range(0));
+    std::vector<Simhash::hash_t> copy(hashes.size()), scratch(hashes.size());
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::copy(hashes.begin(), hashes.end(), copy.begin());
+        state.ResumeTiming();
+        Simhash::radix_sort(copy.data(), scratch.data(), copy.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RadixSort)->Apply(sort_arguments);
+
+// The prefix of a 6-block, 3-bit permutation is 32 bits
+static void BM_RadixSortPrefix(benchmark::State& state)
+{
+    std::vector<Simhash::hash_t> hashes = random_hashes(state.range(0));
+    std::vector<Simhash::hash_t> copy(hashes.size()), scratch(hashes.size());
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::copy(hashes.begin(), hashes.end(), copy.begin());
+        state.ResumeTiming();
+        Simhash::radix_sort(copy.data(), scratch.data(), copy.size(), 32);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RadixSortPrefix)->Apply(sort_arguments);
+
+static void BM_RadixSortParallel(benchmark::State& state)
+{
+    std::vector<Simhash::hash_t> hashes = random_hashes(state.range(0));
+    std::vector<Simhash::hash_t> copy(hashes.size()), scratch(hashes.size());
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::copy(hashes.begin(), hashes.end(), copy.begin());
+        state.ResumeTiming();
+        Simhash::radix_sort(copy.data(), scratch.data(), copy.size(), Simhash::BITS, 0);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RadixSortParallel)->Apply(sort_arguments)->UseRealTime();
@@ -0,0 +1,84 @@
+#ifndef SIMHASH_BENCH_H
+#define SIMHASH_BENCH_H
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <vector>
+
+#include "simhash.h"
+
+namespace Bench {
+
+    /* The block and distance configurations swept by the matching benchmarks,
+     * selected by index. */
+    const size_t CONFIGURATIONS[][2] = { { 6, 3 }, { 8, 3 }, { 10, 4 } };
+
+    inline std::vector<Simhash::hash_t> random_hashes(size_t count)
+    {
+        std::mt19937_64 generator(42);
+        std::vector<Simhash::hash_t> hashes(count);
+        for (Simhash::hash_t& hash : hashes)
+        {
+            hash = generator();
+        }
+        return hashes;
+    }
+
+    /**
+     * A corpus of `count` hashes, of which about `percent` percent are near
+     * duplicates: each is an earlier hash with up to `bits` bits flipped.
+     */
+    inline std::vector<Simhash::hash_t> corpus(size_t count, size_t percent, size_t bits)
+    {
+        std::mt19937_64 generator(42);
+        std::vector<Simhash::hash_t> hashes(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (i == 0 || generator() % 100 >= percent)
+            {
+                hashes[i] = generator();
+                continue;
+            }
+
+            Simhash::hash_t hash = hashes[generator() % i];
+            for (size_t flips = generator() % (bits + 1); flips > 0; --flips)
+            {
+                hash ^= static_cast<Simhash::hash_t>(1) << (generator() % Simhash::BITS);
+            }
+            hashes[i] = hash;
+        }
+        return hashes;
+    }
+
+    /**
+     * Sweep corpus size, configuration and duplicate density, passed as
+     * range(0), range(1) and range(2).
+     */
+    inline void corpus_arguments(benchmark::internal::Benchmark* benchmark)
+    {
+        benchmark->ArgNames({ "hashes", "configuration", "duplicates" });
+        for (long hashes : { 1 << 14, 1 << 17, 1 << 20 })
+        {
+            for (long configuration = 0; configuration < 3; ++configuration)
+            {
+                for (long duplicates : { 0, 10, 50 })
+                {
+                    benchmark->Args({ hashes, configuration, duplicates });
+                }
+            }
+        }
+        benchmark->Unit(benchmark::kMillisecond);
+    }
+
+    /**
+     * Label a benchmark with its configuration, as "blocks/distance".
+     */
+    inline void label_configuration(benchmark::State& state, size_t configuration)
+    {
+        state.SetLabel(std::to_string(CONFIGURATIONS[configuration][0]) + "/" +
+                       std::to_string(CONFIGURATIONS[configuration][1]));
+    }
+}
+
+#endif
@@ -0,0 +1,222 @@
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <fstream>
+
+#include <getopt.h>
+
+#include "simhash.h"
+#include "index.h"
+#include "index_file.h"
+#include "io.h"
+
+void usage(int argc, char** argv)
+{
+    std::cout << "usage: " << argv[0]
+              << " --blocks BLOCKS"
+              << " --distance DISTANCE"
+              << " --input INPUT"
+              << " --output OUTPUT"
+              << " [--input-format FORMAT]"
+              << " [--stride STRIDE]"
+              << " [--directory-bits BITS]"
+              << " [--compress]\n\n"
+              << "Read simhashes from input, and write an index of them to output, which \n"
+              << "can then be used in place as the corpus of simhash-find-all.\n\n"
+              << "  --blocks BLOCKS        Number of bit blocks to use\n"
+              << "  --distance DISTANCE    Maximum bit distances of matches\n"
+              << "  --input INPUT          Path to input ('-' for stdin)\n"
+              << "  --output OUTPUT        Path to output\n"
+              << "  --input-format FORMAT  'text' (default) or 'binary' (little-endian uint64)\n"
+              << "  --stride STRIDE        Also write every STRIDE'th hash of each table, to\n"
+              << "                         speed up searches (default 0, meaning none)\n"
+              << "  --directory-bits BITS  Also write where each value of the leading BITS\n"
+              << "                         bits of each table begins, so that searches read\n"
+              << "                         one entry and scan a short range (default 0,\n"
+              << "                         meaning none; at most 24). Costs 8 * (2^BITS + 1)\n"
+              << "                         bytes per table\n"
+              << "  --compress             Write each table Elias-Fano encoded, in about\n"
+              << "                         64 - log2(hashes) + 2.5 bits per hash rather than\n"
+              << "                         64, in place of any directories\n";
+}
+
+int main(int argc, char **argv) {
+
+    std::string input, output, input_format("text");
+    size_t blocks(0), distance(0), stride(0), directory_bits(0);
+    bool compress(false);
+
+    int getopt_return_value(0);
+    while (getopt_return_value != -1)
+    {
+        int option_index = 0;
+        static struct option long_options[] = {
+            {"input",         required_argument, 0, 0 },
+            {"output",        required_argument, 0, 0 },
+            {"blocks",        required_argument, 0, 0 },
+            {"distance",      required_argument, 0, 0 },
+            {"input-format",  required_argument, 0, 0 },
+            {"stride",        required_argument, 0, 0 },
+            {"help",          no_argument,       0, 0 },
+            {"directory-bits",required_argument, 0, 0 },
+            {"compress",      no_argument,       0, 0 },
+            {0,               0,                 0, 0 }
+        };
+
+        getopt_return_value = getopt_long(
+            argc, argv, "i:o:b:d:h", long_options, &option_index);
+
+        switch(getopt_return_value)
+        {
+            case 0:
+                switch(option_index)
+                {
+                    case 0:
+                        input = optarg;
+                        break;
+                    case 1:
+                        output = optarg;
+                        break;
+                    case 2:
+                        std::stringstream(std::string(optarg)) >> blocks;
+                        break;
+                    case 3:
+                        std::stringstream(std::string(optarg)) >> distance;
+                        break;
+                    case 4:
+                        input_format = optarg;
+                        break;
+                    case 5:
+                        std::stringstream(std::string(optarg)) >> stride;
+                        break;
+                    case 6:
+                        usage(argc, argv);
+                        return 0;
+                    case 7:
+                        std::stringstream(std::string(optarg)) >> directory_bits;
+                        break;
+                    case 8:
+                        compress = true;
+                        break;
+                }
+                break;
+            case 'i':
+                input = optarg;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'b':
+                std::stringstream(std::string(optarg)) >> blocks;
+                break;
+            case 'd':
+                std::stringstream(std::string(optarg)) >> distance;
+                break;
+            case 'h':
+                usage(argc, argv);
+                return 0;
+            case '?':
+                return 1;
+        }
+
+    }
+
+    if (blocks == 0)
+    {
+        std::cerr << "Blocks must be provided and > 0" << std::endl;
+        return 2;
+    }
+
+    if (distance == 0)
+    {
+        std::cerr << "Distance must be provided and > 0" << std::endl;
+        return 3;
+    }
+
+    if (input.empty())
+    {
+        std::cerr << "Input must be provided and non-empty." << std::endl;
+        return 4;
+    }
+
+    if (output.empty() || output.compare("-") == 0)
+    {
+        std::cerr << "Output must be provided and be a file." << std::endl;
+        return 5;
+    }
+
+    if (blocks <= distance)
+    {
+        std::cerr << "Blocks (" << blocks << ") must be >= distance (" << distance << ")"
+                  << std::endl;
+        return 6;
+    }
+
+    if (directory_bits > Simhash::MAX_DIRECTORY_BITS)
+    {
+        std::cerr << "Directory bits (" << directory_bits << ") must be at most "
+                  << Simhash::MAX_DIRECTORY_BITS << std::endl;
+        return 11;
+    }
+
+    Simhash::format_t input_type;
+    try
+    {
+        input_type = Simhash::parse_format(input_format);
+    }
+    catch (const std::invalid_argument& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 9;
+    }
+
+    // Read input
+    std::unique_ptr<Simhash::InputHashes> hashes;
+    if (input.compare("-") == 0)
+    {
+        std::cerr << "Reading hashes from stdin." << std::endl;
+    }
+    else
+    {
+        std::cerr << "Reading hashes from " << input << std::endl;
+    }
+    try
+    {
+        hashes.reset(new Simhash::InputHashes(input, input_type));
+    }
+    catch (const std::exception& error)
+    {
+        std::cerr << "Error reading " << input << ": " << error.what() << std::endl;
+        return 7;
+    }
+
+    // Build and write the index
+    std::cerr << "Building index..." << std::endl;
+    Simhash::Index index(blocks, distance, directory_bits);
+    index.insert(hashes->data(), hashes->size());
+    hashes.reset();
+    if (compress)
+    {
+        size_t plain = index.table_bytes();
+        index.compress();
+        std::cerr << "Compressed tables from " << plain << " to " << index.table_bytes()
+                  << " bytes" << std::endl;
+    }
+    else if (directory_bits)
+    {
+        std::cerr << "Prefix directories use " << index.directory_bytes() << " bytes" << std::endl;
+    }
+
+    std::cerr << "Writing index to " << output << std::endl;
+    try
+    {
+        Simhash::write_index(index, output, stride);
+    }
+    catch (const std::exception& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 8;
+    }
+
+    return 0;
+}
@@ -1,11 +1,18 @@
+#include <cstdlib>
 #include <iostream>
-#include <unordered_set>
+#include <limits>
+#include <memory>
 #include <sstream>
 #include <fstream>
 
 #include <getopt.h>
 
 #include "simhash.h"
+#include "external.h"
+#include "index.h"
+#include "index_file.h"
+#include "io.h"
+#include "planner.h"
 
 void usage(int argc, char** argv)
 {
@@ -13,55 +20,165 @@ void usage(int argc, char** argv)
               << " --blocks BLOCKS"
               << " --distance DISTANCE"
               << " --input INPUT"
-              << " --output OUTPUT\n\n"
+              << " --output OUTPUT"
+              << " [--threads THREADS]"
+              << " [--input-format FORMAT]"
+              << " [--output-format FORMAT]"
+              << " [--memory-budget BYTES]"
+              << " [--temporary-directory DIRECTORY]"
+              << " [--with-distances]"
+              << " [--shard SHARD/SHARDS]\n"
+              << "       " << argv[0]
+              << " --blocks BLOCKS"
+              << " --distance DISTANCE"
+              << " --corpus CORPUS"
+              << " --queries QUERIES"
+              << " --output OUTPUT"
+              << " [...]\n\n"
               << "Read simhashes from input, find all pairs within distance bits of \n"
               << "each other, writing them to output. The endianness of the output is \n"
               << "the same as that of the input.\n\n"
-              << "  --blocks BLOCKS        Number of bit blocks to use\n"
+              << "With a corpus and queries instead, find only the pairs that include \n"
+              << "at least one of the queries.\n\n"
+              << "  --blocks BLOCKS        Number of bit blocks to use, or 'auto' to choose\n"
+              << "                         the number estimated to be fastest\n"
               << "  --distance DISTANCE    Maximum bit distances of matches\n"
               << "  --input INPUT          Path to input ('-' for stdin)\n"
-              << "  --output OUTPUT        Path to output ('-' for stdout)\n";
+              << "  --output OUTPUT        Path to output ('-' for stdout)\n"
+              << "  --threads THREADS      Number of threads to use (0 for all cores, default 1)\n"
+              << "  --input-format FORMAT  'text' (default) or 'binary' (little-endian uint64)\n"
+              << "  --output-format FORMAT 'text' (default) or 'binary'\n"
+              << "  --memory-budget BYTES  Find matches out of core, using about this much\n"
+              << "                         memory (K, M and G suffixes allowed). Matches are\n"
+              << "                         then written unsorted, and only one thread is used\n"
+              << "  --temporary-directory DIRECTORY\n"
+              << "                         Where to put temporary files (default $TMPDIR or /tmp)\n"
+              << "  --corpus CORPUS        Path to hashes already known to have been matched,\n"
+              << "                         or to an index of them from simhash-build-index.\n"
+              << "                         Plain hashes are indexed anew on every run, at a\n"
+              << "                         cost that grows with the corpus; an index file\n"
+              << "                         avoids it, leaving a cost that grows with the queries\n"
+              << "  --queries QUERIES      Path to new hashes to match against the corpus\n"
+              << "  --with-distances       Follow each match with the number of bits in which\n"
+              << "                         it differs, so that one run at the largest distance\n"
+              << "                         serves every smaller one\n"
+              << "  --shard SHARD/SHARDS   Find only one of SHARDS disjoint shards of the\n"
+              << "                         matches (numbered from 0), each scanning its own\n"
+              << "                         share of the tables. Combine their binary outputs\n"
+              << "                         with simhash-merge\n";
 }
 
-std::unordered_set<Simhash::hash_t> read_hashes(std::istream& stream)
+/**
+ * Parse a number of bytes, with an optional K, M or G suffix. Returns 0 if
+ * invalid, including if it's too large to represent.
+ */
+size_t parse_bytes(const std::string& value)
 {
-    std::unordered_set<Simhash::hash_t> hashes;
-    for (std::string line; std::getline(stream, line); )
+    size_t bytes(0);
+    std::string suffix;
+    std::stringstream stream(value);
+    if (value.find('-') != std::string::npos || !(stream >> bytes))
     {
-        hashes.insert(std::stoull(line));
+        return 0;
     }
-    return hashes;
+    stream >> suffix;
+
+    size_t unit(1);
+    if (suffix == "K")
+    {
+        unit = static_cast<size_t>(1) << 10;
+    }
+    else if (suffix == "M")
+    {
+        unit = static_cast<size_t>(1) << 20;
+    }
+    else if (suffix == "G")
+    {
+        unit = static_cast<size_t>(1) << 30;
+    }
+    else if (!suffix.empty())
+    {
+        return 0;
+    }
+
+    if (bytes > std::numeric_limits<size_t>::max() / unit)
+    {
+        return 0;
+    }
+    return bytes * unit;
+}
+
+/**
+ * Parse a shard of the form SHARD/SHARDS. Returns false if invalid.
+ */
+bool parse_shard(const std::string& value, size_t& shard, size_t& shards)
+{
+    char separator(0);
+    std::stringstream stream(value);
+    stream >> shard >> separator >> shards;
+    return !stream.fail() && stream.eof() && separator == '/' && shard < shards;
 }
 
-void write_matches(std::ostream& stream, const Simhash::matches_t& matches)
+/**
+ * Read hashes from a path ('-' for stdin), returning null once the error has
+ * been reported if they can't be read.
+ */
+std::unique_ptr<Simhash::InputHashes> read_hashes(const std::string& path,
+                                                  Simhash::format_t format)
 {
-    for (auto it = matches.begin(); it != matches.end() && !std::cout.fail(); ++it)
+    if (path.compare("-") == 0)
+    {
+        std::cerr << "Reading hashes from stdin." << std::endl;
+    }
+    else
+    {
+        std::cerr << "Reading hashes from " << path << std::endl;
+    }
+
+    std::unique_ptr<Simhash::InputHashes> hashes;
+    try
     {
-        stream << "[" << it->first << ", " << it->second << "]\n";
+        hashes.reset(new Simhash::InputHashes(path, format));
     }
-    stream.flush();
+    catch (const std::exception& error)
+    {
+        std::cerr << "Error reading " << path << ": " << error.what() << std::endl;
+    }
+    return hashes;
 }
 
 int main(int argc, char **argv) {
 
-    std::string input, output;
-    size_t blocks(0), distance(0);
+    std::string input, output, input_format("text"), output_format("text");
+    std::string corpus, queries;
+    std::string temporary_directory(getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    bool auto_blocks(false), distances(false), sharded(false);
+    size_t blocks(0), distance(0), threads(1), memory_budget(0), shard(0), shards(1);
 
     int getopt_return_value(0);
     while (getopt_return_value != -1)
     {
         int option_index = 0;
         static struct option long_options[] = {
-            {"input",    required_argument, 0, 0 },
-            {"output",   required_argument, 0, 0 },
-            {"blocks",   required_argument, 0, 0 },
-            {"distance", required_argument, 0, 0 },
-            {"help",     no_argument,       0, 0 },
-            {0,          0,                 0, 0 }
+            {"input",               required_argument, 0, 0 },
+            {"output",              required_argument, 0, 0 },
+            {"blocks",              required_argument, 0, 0 },
+            {"distance",            required_argument, 0, 0 },
+            {"threads",             required_argument, 0, 0 },
+            {"input-format",        required_argument, 0, 0 },
+            {"output-format",       required_argument, 0, 0 },
+            {"memory-budget",       required_argument, 0, 0 },
+            {"temporary-directory", required_argument, 0, 0 },
+            {"corpus",              required_argument, 0, 0 },
+            {"queries",             required_argument, 0, 0 },
+            {"help",                no_argument,       0, 0 },
+            {"with-distances",      no_argument,       0, 0 },
+            {"shard",               required_argument, 0, 0 },
+            {0,                     0,                 0, 0 }
         };
 
         getopt_return_value = getopt_long(
-            argc, argv, "i:o:b:d:h", long_options, &option_index);
+            argc, argv, "i:o:b:d:t:h", long_options, &option_index);
 
         switch(getopt_return_value)
         {
@@ -75,14 +192,52 @@ int main(int argc, char **argv) {
                         output = optarg;
                         break;
                     case 2:
+                        auto_blocks = std::string(optarg) == "auto";
                         std::stringstream(std::string(optarg)) >> blocks;
                         break;
                     case 3:
                         std::stringstream(std::string(optarg)) >> distance;
                         break;
                     case 4:
+                        std::stringstream(std::string(optarg)) >> threads;
+                        break;
+                    case 5:
+                        input_format = optarg;
+                        break;
+                    case 6:
+                        output_format = optarg;
+                        break;
+                    case 7:
+                        memory_budget = parse_bytes(optarg);
+                        if (memory_budget == 0)
+                        {
+                            std::cerr << "Invalid memory budget: " << optarg << std::endl;
+                            return 1;
+                        }
+                        break;
+                    case 8:
+                        temporary_directory = optarg;
+                        break;
+                    case 9:
+                        corpus = optarg;
+                        break;
+                    case 10:
+                        queries = optarg;
+                        break;
+                    case 11:
                         usage(argc, argv);
                         return 0;
+                    case 12:
+                        distances = true;
+                        break;
+                    case 13:
+                        sharded = true;
+                        if (!parse_shard(optarg, shard, shards))
+                        {
+                            std::cerr << "Invalid shard: " << optarg << std::endl;
+                            return 1;
+                        }
+                        break;
                 }
                 break;
             case 'i':
@@ -92,11 +247,15 @@ int main(int argc, char **argv) {
                 output = optarg;
                 break;
             case 'b':
+                auto_blocks = std::string(optarg) == "auto";
                 std::stringstream(std::string(optarg)) >> blocks;
                 break;
             case 'd':
                 std::stringstream(std::string(optarg)) >> distance;
                 break;
+            case 't':
+                std::stringstream(std::string(optarg)) >> threads;
+                break;
             case 'h':
                 usage(argc, argv);
                 return 0;
@@ -106,7 +265,7 @@ int main(int argc, char **argv) {
 
     }
 
-    if (blocks == 0)
+    if (blocks == 0 && !auto_blocks)
     {
         std::cerr << "Blocks must be provided and > 0" << std::endl;
         return 2;
@@ -118,9 +277,22 @@ int main(int argc, char **argv) {
         return 3;
     }
 
-    if (input.empty())
+    bool probe = !corpus.empty() || !queries.empty();
+    if (probe ? (corpus.empty() || queries.empty() || !input.empty()) : input.empty())
+    {
+        std::cerr << "Either input, or both corpus and queries, must be provided." << std::endl;
+        return 4;
+    }
+
+    if (probe && memory_budget > 0)
+    {
+        std::cerr << "A memory budget cannot be used with a corpus." << std::endl;
+        return 4;
+    }
+
+    if (sharded && (probe || memory_budget > 0))
     {
-        std::cerr << "Input must be provided and non-empty." << std::endl;
+        std::cerr << "A shard cannot be used with a corpus or a memory budget." << std::endl;
         return 4;
     }
 
@@ -130,57 +302,158 @@ int main(int argc, char **argv) {
         return 5;
     }
 
-    if (blocks <= distance)
+    if (blocks <= distance && !auto_blocks)
     {
         std::cerr << "Blocks (" << blocks << ") must be >= distance (" << distance << ")"
                   << std::endl;
         return 6;
     }
 
-    // Read input
-    std::unordered_set<Simhash::hash_t> hashes;
-    if (input.compare("-") == 0)
+    Simhash::format_t input_type, output_type;
+    try
     {
-        std::cerr << "Reading hashes from stdin." << std::endl;
-        hashes = read_hashes(std::cin);
+        input_type = Simhash::parse_format(input_format);
+        output_type = Simhash::parse_format(output_format);
     }
-    else
+    catch (const std::invalid_argument& error)
     {
-        std::cerr << "Reading hashes from " << input << std::endl;
+        std::cerr << error.what() << std::endl;
+        return 9;
+    }
+
+    // Read input
+    std::unique_ptr<Simhash::InputHashes> hashes, corpus_hashes;
+    std::unique_ptr<Simhash::MappedIndex> corpus_index;
+    if (probe)
+    {
+        // The corpus may be an index from simhash-build-index, used in place
+        if (Simhash::is_index_file(corpus))
         {
-            std::ifstream fin(input, std::ifstream::in | std::ifstream::binary);
-            if (!fin.good())
+            std::cerr << "Mapping index " << corpus << std::endl;
+            try
+            {
+                corpus_index.reset(new Simhash::MappedIndex(corpus));
+            }
+            catch (const std::exception& error)
             {
-                std::cerr << "Error reading " << input << std::endl;
+                std::cerr << error.what() << std::endl;
                 return 7;
             }
-            hashes = read_hashes(fin);
+            if (auto_blocks)
+            {
+                blocks = corpus_index->number_of_blocks();
+            }
+            if (corpus_index->number_of_blocks() != blocks ||
+                corpus_index->different_bits() != distance)
+            {
+                std::cerr << "Index " << corpus << " was built with blocks "
+                          << corpus_index->number_of_blocks() << " and distance "
+                          << corpus_index->different_bits() << std::endl;
+                return 6;
+            }
+        }
+        else
+        {
+            corpus_hashes = read_hashes(corpus, input_type);
+        }
+        hashes = read_hashes(queries, input_type);
+        if (!(corpus_index || corpus_hashes) || !hashes)
+        {
+            return 7;
+        }
+    }
+    else
+    {
+        hashes = read_hashes(input, input_type);
+        if (!hashes)
+        {
+            return 7;
         }
     }
 
-    // Find matches
-    std::cerr << "Computing matches..." << std::endl;
-    Simhash::matches_t results = Simhash::find_all(hashes, blocks, distance);
+    if (auto_blocks && !corpus_index)
+    {
+        const Simhash::InputHashes& sample = corpus_hashes ? *corpus_hashes : *hashes;
+        try
+        {
+            Simhash::Plan plan = Simhash::choose_plan(sample.data(), sample.size(), distance);
+            std::cerr << "Using " << Simhash::describe_plan(plan) << std::endl;
+            blocks = plan.number_of_blocks;
+        }
+        catch (const std::invalid_argument& error)
+        {
+            std::cerr << error.what() << std::endl;
+            return 6;
+        }
+    }
 
-    // Write output
+    // Open output
+    std::ofstream fout;
+    std::ostream* stream(&std::cout);
     if (output.compare("-") == 0)
     {
         std::cerr << "Writing results to stdout." << std::endl;
-        write_matches(std::cout, results);
     }
     else
     {
         std::cerr << "Writing matches to " << output << std::endl;
+        fout.open(output, std::ofstream::binary);
+        if (!fout.good())
         {
-            std::ofstream fout(output, std::ofstream::binary);
-            if (!fout.good())
-            {
-                std::cerr << "Error writing " << output << std::endl;
-                return 8;
-            }
-            write_matches(fout, results);
+            std::cerr << "Error writing " << output << std::endl;
+            return 8;
+        }
+        stream = &fout;
+    }
+
+    // Find matches
+    std::cerr << "Computing matches..." << std::endl;
+    if (memory_budget > 0)
+    {
+        // Write matches as they're found
+        Simhash::Writer writer(*stream);
+        auto emit = [&writer, output_type, distances](const Simhash::match_t& match) {
+            Simhash::write_match(writer, match, output_type, distances);
+        };
+        try
+        {
+            Simhash::find_all_external(hashes->data(), hashes->size(), blocks, distance,
+                                       memory_budget, temporary_directory, emit);
+        }
+        catch (const std::exception& error)
+        {
+            std::cerr << "Error computing matches: " << error.what() << std::endl;
+            return 10;
         }
     }
+    else if (corpus_index)
+    {
+        Simhash::sorted_matches_t results =
+            corpus_index->probe(hashes->data(), hashes->size(), threads);
+        Simhash::write_matches(*stream, results, output_type, distances);
+    }
+    else if (probe)
+    {
+        // Only the queries need to be matched against the corpus' tables,
+        // but those have to be built first, for the whole corpus
+        Simhash::Index index(blocks, distance);
+        index.insert(corpus_hashes->data(), corpus_hashes->size());
+        corpus_hashes.reset();
+        Simhash::sorted_matches_t results = index.probe(hashes->data(), hashes->size(), threads);
+        Simhash::write_matches(*stream, results, output_type, distances);
+    }
+    else if (sharded)
+    {
+        Simhash::sorted_matches_t results = Simhash::find_all_sorted_shard(
+            hashes->data(), hashes->size(), blocks, distance, shard, shards, threads);
+        Simhash::write_matches(*stream, results, output_type, distances);
+    }
+    else
+    {
+        Simhash::sorted_matches_t results = Simhash::find_all_sorted(
+            hashes->data(), hashes->size(), blocks, distance, threads);
+        Simhash::write_matches(*stream, results, output_type, distances);
+    }
 
     return 0;
 }
@@ -1,11 +1,13 @@
 #include <iostream>
-#include <unordered_set>
+#include <memory>
 #include <sstream>
 #include <fstream>
 
 #include <getopt.h>
 
 #include "simhash.h"
+#include "planner.h"
+#include "io.h"
 
 void usage(int argc, char** argv)
 {
@@ -13,60 +15,46 @@ void usage(int argc, char** argv)
               << " --blocks BLOCKS"
               << " --distance DISTANCE"
               << " --input INPUT"
-              << " --output OUTPUT\n\n"
+              << " --output OUTPUT"
+              << " [--threads THREADS]"
+              << " [--input-format FORMAT]"
+              << " [--output-format FORMAT]\n\n"
               << "Read simhashes from input, finds all clusters using the provided \n"
               << "distance threshold, writing them to output.\n\n"
-              << "  --blocks BLOCKS        Number of bit blocks to use\n"
+              << "  --blocks BLOCKS        Number of bit blocks to use, or 'auto' to choose\n"
+              << "                         the number estimated to be fastest\n"
               << "  --distance DISTANCE    Maximum bit distances of matches\n"
               << "  --input INPUT          Path to input ('-' for stdin)\n"
-              << "  --output OUTPUT        Path to output ('-' for stdout)\n";
-}
-
-std::unordered_set<Simhash::hash_t> read_hashes(std::istream& stream)
-{
-    std::unordered_set<Simhash::hash_t> hashes;
-    for (std::string line; std::getline(stream, line); )
-    {
-        hashes.insert(std::stoull(line));
-    }
-    return hashes;
-}
-
-void write_clusters(std::ostream& stream, const Simhash::clusters_t& clusters)
-{
-    for (const auto& cluster : clusters)
-    {
-        auto it = cluster.begin();
-        stream << "[" << *(it++);
-        for (; it != cluster.end(); ++it)
-        {
-            stream << ", " << *it;
-        }
-        stream << "]\n";
-    }
-    stream.flush();
+              << "  --output OUTPUT        Path to output ('-' for stdout)\n"
+              << "  --threads THREADS      Number of threads to use (0 for all cores, default 1)\n"
+              << "  --input-format FORMAT  'text' (default) or 'binary' (little-endian uint64)\n"
+              << "  --output-format FORMAT 'text' (default) or 'binary'\n";
 }
 
 int main(int argc, char **argv) {
 
-    std::string input, output;
-    size_t blocks(0), distance(0);
+    std::string input, output, input_format("text"), output_format("text");
+    bool auto_blocks(false);
+    size_t blocks(0), distance(0), threads(1);
 
     int getopt_return_value(0);
     while (getopt_return_value != -1)
     {
         int option_index = 0;
         static struct option long_options[] = {
-            {"input",    required_argument, 0, 0 },
-            {"output",   required_argument, 0, 0 },
-            {"blocks",   required_argument, 0, 0 },
-            {"distance", required_argument, 0, 0 },
-            {"help",     no_argument,       0, 0 },
-            {0,          0,                 0, 0 }
+            {"input",         required_argument, 0, 0 },
+            {"output",        required_argument, 0, 0 },
+            {"blocks",        required_argument, 0, 0 },
+            {"distance",      required_argument, 0, 0 },
+            {"threads",       required_argument, 0, 0 },
+            {"input-format",  required_argument, 0, 0 },
+            {"output-format", required_argument, 0, 0 },
+            {"help",          no_argument,       0, 0 },
+            {0,               0,                 0, 0 }
         };
 
         getopt_return_value = getopt_long(
-            argc, argv, "i:o:b:d:h", long_options, &option_index);
+            argc, argv, "i:o:b:d:t:h", long_options, &option_index);
 
         switch(getopt_return_value)
         {
@@ -80,12 +68,22 @@ int main(int argc, char **argv) {
                         output = optarg;
                         break;
                     case 2:
+                        auto_blocks = std::string(optarg) == "auto";
                         std::stringstream(std::string(optarg)) >> blocks;
                         break;
                     case 3:
                         std::stringstream(std::string(optarg)) >> distance;
                         break;
                     case 4:
+                        std::stringstream(std::string(optarg)) >> threads;
+                        break;
+                    case 5:
+                        input_format = optarg;
+                        break;
+                    case 6:
+                        output_format = optarg;
+                        break;
+                    case 7:
                         usage(argc, argv);
                         return 0;
                 }
@@ -97,11 +95,15 @@ int main(int argc, char **argv) {
                 output = optarg;
                 break;
             case 'b':
+                auto_blocks = std::string(optarg) == "auto";
                 std::stringstream(std::string(optarg)) >> blocks;
                 break;
             case 'd':
                 std::stringstream(std::string(optarg)) >> distance;
                 break;
+            case 't':
+                std::stringstream(std::string(optarg)) >> threads;
+                break;
             case 'h':
                 usage(argc, argv);
                 return 0;
@@ -111,7 +113,7 @@ int main(int argc, char **argv) {
 
     }
 
-    if (blocks == 0)
+    if (blocks == 0 && !auto_blocks)
     {
         std::cerr << "Blocks must be provided and > 0" << std::endl;
         return 2;
@@ -135,43 +137,70 @@ int main(int argc, char **argv) {
         return 5;
     }
 
-    if (blocks <= distance)
+    if (blocks <= distance && !auto_blocks)
     {
         std::cerr << "Blocks (" << blocks << ") must be > distance (" << distance << ")"
                   << std::endl;
         return 6;
     }
 
+    Simhash::format_t input_type, output_type;
+    try
+    {
+        input_type = Simhash::parse_format(input_format);
+        output_type = Simhash::parse_format(output_format);
+    }
+    catch (const std::invalid_argument& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 9;
+    }
+
     // Read input
-    std::unordered_set<Simhash::hash_t> hashes;
+    std::unique_ptr<Simhash::InputHashes> hashes;
     if (input.compare("-") == 0)
     {
         std::cerr << "Reading hashes from stdin." << std::endl;
-        hashes = read_hashes(std::cin);
     }
     else
     {
         std::cerr << "Reading hashes from " << input << std::endl;
+    }
+    try
+    {
+        hashes.reset(new Simhash::InputHashes(input, input_type));
+    }
+    catch (const std::exception& error)
+    {
+        std::cerr << "Error reading " << input << ": " << error.what() << std::endl;
+        return 7;
+    }
+
+    if (auto_blocks)
+    {
+        try
         {
-            std::ifstream fin(input, std::ifstream::in | std::ifstream::binary);
-            if (!fin.good())
-            {
-                std::cerr << "Error reading " << input << std::endl;
-                return 7;
-            }
-            hashes = read_hashes(fin);
+            Simhash::Plan plan = Simhash::choose_plan(hashes->data(), hashes->size(), distance);
+            std::cerr << "Using " << Simhash::describe_plan(plan) << std::endl;
+            blocks = plan.number_of_blocks;
+        }
+        catch (const std::invalid_argument& error)
+        {
+            std::cerr << error.what() << std::endl;
+            return 6;
         }
     }
 
     // Find matches
     std::cerr << "Computing clusters..." << std::endl;
-    Simhash::clusters_t results = Simhash::find_clusters(hashes, blocks, distance);
+    Simhash::clusters_t results = Simhash::find_clusters(
+        hashes->data(), hashes->size(), blocks, distance, threads);
 
     // Write output
     if (output.compare("-") == 0)
     {
         std::cerr << "Writing results to stdout." << std::endl;
-        write_clusters(std::cout, results);
+        Simhash::write_clusters(std::cout, results, output_type);
     }
     else
     {
@@ -183,7 +212,7 @@ int main(int argc, char **argv) {
                 std::cerr << "Error writing " << output << std::endl;
                 return 8;
             }
-            write_clusters(fout, results);
+            Simhash::write_clusters(fout, results, output_type);
         }
     }
 
@@ -0,0 +1,141 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#include "simhash.h"
+#include "io.h"
+
+void usage(int argc, char** argv)
+{
+    std::cout << "usage: " << argv[0]
+              << " --output OUTPUT"
+              << " [--output-format FORMAT]"
+              << " [--with-distances]"
+              << " INPUT...\n\n"
+              << "Merge the binary outputs of simhash-find-all, such as those of each of its\n"
+              << "shards, into a single sorted output without duplicates.\n\n"
+              << "  --output OUTPUT        Path to output ('-' for stdout)\n"
+              << "  --output-format FORMAT 'text' (default) or 'binary'\n"
+              << "  --with-distances       The inputs were written with --with-distances, and\n"
+              << "                         so is the output\n";
+}
+
+int main(int argc, char **argv) {
+
+    std::string output, output_format("text");
+    bool distances(false);
+
+    int getopt_return_value(0);
+    while (getopt_return_value != -1)
+    {
+        int option_index = 0;
+        static struct option long_options[] = {
+            {"output",         required_argument, 0, 0 },
+            {"output-format",  required_argument, 0, 0 },
+            {"with-distances", no_argument,       0, 0 },
+            {"help",           no_argument,       0, 0 },
+            {0,                0,                 0, 0 }
+        };
+
+        getopt_return_value = getopt_long(
+            argc, argv, "o:h", long_options, &option_index);
+
+        switch(getopt_return_value)
+        {
+            case 0:
+                switch(option_index)
+                {
+                    case 0:
+                        output = optarg;
+                        break;
+                    case 1:
+                        output_format = optarg;
+                        break;
+                    case 2:
+                        distances = true;
+                        break;
+                    case 3:
+                        usage(argc, argv);
+                        return 0;
+                }
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'h':
+                usage(argc, argv);
+                return 0;
+            case '?':
+                return 1;
+        }
+
+    }
+
+    std::vector<std::string> inputs(argv + optind, argv + argc);
+    if (inputs.empty())
+    {
+        std::cerr << "At least one input must be provided." << std::endl;
+        return 4;
+    }
+
+    if (output.empty())
+    {
+        std::cerr << "Output must be provided and non-empty." << std::endl;
+        return 5;
+    }
+
+    Simhash::format_t output_type;
+    try
+    {
+        output_type = Simhash::parse_format(output_format);
+    }
+    catch (const std::invalid_argument& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 9;
+    }
+
+    // Open output
+    std::ofstream fout;
+    std::ostream* stream(&std::cout);
+    if (output.compare("-") == 0)
+    {
+        std::cerr << "Writing results to stdout." << std::endl;
+    }
+    else
+    {
+        std::cerr << "Writing matches to " << output << std::endl;
+        fout.open(output, std::ofstream::binary);
+        if (!fout.good())
+        {
+            std::cerr << "Error writing " << output << std::endl;
+            return 8;
+        }
+        stream = &fout;
+    }
+
+    std::cerr << "Merging " << inputs.size() << " inputs..." << std::endl;
+    size_t written(0);
+    try
+    {
+        written = Simhash::merge_matches(inputs, *stream, output_type, distances);
+    }
+    catch (const std::exception& error)
+    {
+        std::cerr << "Error reading matches: " << error.what() << std::endl;
+        return 7;
+    }
+
+    if (!stream->good())
+    {
+        std::cerr << "Error writing " << output << std::endl;
+        return 8;
+    }
+    std::cerr << "Wrote " << written << " matches" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include "cpu.h"
+
+#include <atomic>
+
+namespace Simhash {
+
+    namespace {
+        std::atomic<int> isa_limit(ISA_AVX512);
+    }
+
+    isa_t detect_isa()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        static const isa_t detected = []() -> isa_t {
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f") &&
+                __builtin_cpu_supports("avx512bw") &&
+                __builtin_cpu_supports("avx512vpopcntdq"))
+            {
+                return ISA_AVX512;
+            }
+            if (__builtin_cpu_supports("avx2"))
+            {
+                return ISA_AVX2;
+            }
+            if (__builtin_cpu_supports("popcnt"))
+            {
+                return ISA_POPCNT;
+            }
+            return ISA_SCALAR;
+        }();
+        return detected;
+#else
+        return ISA_SCALAR;
+#endif
+    }
+
+    isa_t isa()
+    {
+        int limit = isa_limit;
+        int detected = detect_isa();
+        return static_cast<isa_t>(limit < detected ? limit : detected);
+    }
+
+    isa_t limit_isa(isa_t limit)
+    {
+        return static_cast<isa_t>(isa_limit.exchange(limit));
+    }
+}
@@ -0,0 +1,255 @@
+#include "elias_fano.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace Simhash {
+
+    namespace {
+
+        /* The number of uint64 values before the skip pointers. */
+        const size_t HEADER = 4;
+
+        /**
+         * The number of low bits that minimizes the size of `size` hashes.
+         */
+        size_t choose_low_bits(size_t size)
+        {
+            size_t log(0);
+            while (log < BITS && (static_cast<uint64_t>(1) << log) < size)
+            {
+                ++log;
+            }
+            return std::min(BITS - log, BITS - 1);
+        }
+
+        size_t words_for(size_t bits)
+        {
+            return (bits + 63) / 64;
+        }
+
+        /**
+         * The position of the n'th (from 0) set bit of word, which has more.
+         */
+        size_t select(uint64_t word, size_t n)
+        {
+            for (; n > 0; --n)
+            {
+                word &= word - 1;
+            }
+            return __builtin_ctzll(word);
+        }
+    }
+
+    const size_t EliasFano::SKIP;
+
+    std::vector<uint64_t> EliasFano::encode(const hash_t* data, size_t size)
+    {
+        size_t low_bits = choose_low_bits(size);
+        size_t buckets = size ? (data[size - 1] >> low_bits) + 1 : 0;
+        size_t skips = (buckets + SKIP - 1) / SKIP;
+        size_t low_words = words_for(size * low_bits);
+        size_t high_words = words_for(size + buckets);
+
+        std::vector<uint64_t> words(HEADER + skips + low_words + high_words, 0);
+        words[0] = size;
+        words[1] = low_bits;
+        words[2] = buckets;
+        words[3] = skips;
+        uint64_t* skip = words.data() + HEADER;
+        uint64_t* low = skip + skips;
+        uint64_t* high = low + low_words;
+
+        hash_t mask = (static_cast<hash_t>(1) << low_bits) - 1;
+        size_t bucket(0);
+        for (size_t i = 0; i < size; ++i)
+        {
+            // Every run of equal high bits ends with a zero
+            for (hash_t top = data[i] >> low_bits; bucket <= top; ++bucket)
+            {
+                if (bucket % SKIP == 0)
+                {
+                    skip[bucket / SKIP] = bucket + i;
+                }
+            }
+            size_t position = (data[i] >> low_bits) + i;
+            high[position / 64] |= static_cast<uint64_t>(1) << (position % 64);
+
+            size_t offset = i * low_bits;
+            hash_t value = data[i] & mask;
+            low[offset / 64] |= value << (offset % 64);
+            if (offset % 64 + low_bits > 64)
+            {
+                low[offset / 64 + 1] |= value >> (64 - offset % 64);
+            }
+        }
+        return words;
+    }
+
+    EliasFano::EliasFano()
+        : words_(nullptr)
+        , length_(0)
+        , size_(0)
+        , low_bits_(0)
+        , buckets_(0)
+        , skips_(nullptr)
+        , low_(nullptr)
+        , high_(nullptr)
+        , high_words_(0)
+    {}
+
+    EliasFano::EliasFano(const uint64_t* words, size_t length)
+        : words_(words)
+        , length_(length)
+        , size_(0)
+        , low_bits_(0)
+        , buckets_(0)
+        , skips_(nullptr)
+        , low_(nullptr)
+        , high_(nullptr)
+        , high_words_(0)
+    {
+        if (length < HEADER)
+        {
+            throw std::invalid_argument("Elias-Fano encoding is missing its header");
+        }
+
+        size_ = words[0];
+        low_bits_ = words[1];
+        buckets_ = words[2];
+        size_t skips = words[3];
+        if (size_ > length * 64 || low_bits_ != choose_low_bits(size_) ||
+            buckets_ > length * 64 || skips != (buckets_ + SKIP - 1) / SKIP)
+        {
+            throw std::invalid_argument("Elias-Fano encoding has an invalid header");
+        }
+
+        size_t low_words = words_for(size_ * low_bits_);
+        high_words_ = words_for(size_ + buckets_);
+        if (HEADER + skips + low_words + high_words_ != length)
+        {
+            std::stringstream message;
+            message << "Elias-Fano encoding of " << size_ << " hashes can't be "
+                    << length << " words";
+            throw std::invalid_argument(message.str());
+        }
+
+        skips_ = words + HEADER;
+        low_ = skips_ + skips;
+        high_ = low_ + low_words;
+        for (size_t i = 0; i < skips; ++i)
+        {
+            if (skips_[i] >= size_ + buckets_ || (i > 0 && skips_[i] < skips_[i - 1]))
+            {
+                throw std::invalid_argument("Elias-Fano encoding has invalid skip pointers");
+            }
+        }
+    }
+
+    void EliasFano::decode_range(hash_t low, hash_t high, std::vector<hash_t>& results) const
+    {
+        size_t bucket = low >> low_bits_;
+        if (low > high || bucket >= buckets_)
+        {
+            return;
+        }
+
+        /* Start from the skip pointer before the bucket, and pass over as
+         * many zeros as there are buckets in between. */
+        size_t position = skips_[bucket / SKIP];
+        size_t zeros = bucket % SKIP;
+        while (zeros > 0 && position / 64 < high_words_)
+        {
+            uint64_t word = ~high_[position / 64] & (~static_cast<uint64_t>(0) << (position % 64));
+            size_t count = __builtin_popcountll(word);
+            if (count < zeros)
+            {
+                zeros -= count;
+                position = (position / 64 + 1) * 64;
+            }
+            else
+            {
+                position = (position / 64) * 64 + select(word, zeros - 1) + 1;
+                zeros = 0;
+            }
+        }
+
+        // Each set bit is a hash, whose high bits are the zeros before it
+        size_t i = position - bucket;
+        size_t word = position / 64;
+        if (word >= high_words_)
+        {
+            return;
+        }
+        uint64_t bits = high_[word] & (~static_cast<uint64_t>(0) << (position % 64));
+        while (i < size_)
+        {
+            while (bits == 0)
+            {
+                if (++word == high_words_)
+                {
+                    return;
+                }
+                bits = high_[word];
+            }
+            position = word * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+
+            hash_t value = (static_cast<hash_t>(position - i) << low_bits_) | this->low(i);
+            if (value > high)
+            {
+                return;
+            }
+            if (value >= low)
+            {
+                results.push_back(value);
+            }
+            ++i;
+        }
+    }
+
+    void EliasFano::decode(hash_t* output) const
+    {
+        size_t i(0);
+        for (size_t word = 0; word < high_words_ && i < size_; ++word)
+        {
+            for (uint64_t bits = high_[word]; bits != 0 && i < size_; bits &= bits - 1, ++i)
+            {
+                size_t position = word * 64 + __builtin_ctzll(bits);
+                output[i] = (static_cast<hash_t>(position - i) << low_bits_) | low(i);
+            }
+        }
+    }
+
+    size_t EliasFano::size() const
+    {
+        return size_;
+    }
+
+    const uint64_t* EliasFano::words() const
+    {
+        return words_;
+    }
+
+    size_t EliasFano::length() const
+    {
+        return length_;
+    }
+
+    hash_t EliasFano::low(size_t i) const
+    {
+        if (low_bits_ == 0)
+        {
+            return 0;
+        }
+
+        size_t offset = i * low_bits_;
+        hash_t value = low_[offset / 64] >> (offset % 64);
+        if (offset % 64 + low_bits_ > 64)
+        {
+            value |= low_[offset / 64 + 1] << (64 - offset % 64);
+        }
+        return value & ((static_cast<hash_t>(1) << low_bits_) - 1);
+    }
+}
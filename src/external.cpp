@@ -0,0 +1,292 @@
+#include "external.h"
+#include "permutation.h"
+#include "sort.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <unistd.h>
+
+namespace Simhash {
+
+    namespace {
+
+        /* The smallest buffer used for reading a run while merging. */
+        const size_t MINIMUM_BUFFER = 1024;
+
+        /**
+         * A file of sorted, permuted hashes in native byte order, removed when
+         * it's destroyed.
+         */
+        class Run {
+        public:
+            explicit Run(const std::string& directory)
+                : path_(directory + "/simhash-run-XXXXXX")
+                , file_(nullptr)
+            {
+                std::vector<char> path(path_.begin(), path_.end());
+                path.push_back('\0');
+                int fd = mkstemp(path.data());
+                if (fd < 0)
+                {
+                    throw std::runtime_error("Could not create a run in " + directory);
+                }
+                path_ = path.data();
+                file_ = fdopen(fd, "w+b");
+                if (!file_)
+                {
+                    close(fd);
+                    std::remove(path_.c_str());
+                    throw std::runtime_error("Could not open " + path_);
+                }
+            }
+
+            ~Run()
+            {
+                std::fclose(file_);
+                std::remove(path_.c_str());
+            }
+
+            void write(const hash_t* hashes, size_t count)
+            {
+                if (std::fwrite(hashes, sizeof(hash_t), count, file_) != count)
+                {
+                    throw std::runtime_error("Could not write to " + path_);
+                }
+            }
+
+            void rewind()
+            {
+                std::fflush(file_);
+                std::rewind(file_);
+            }
+
+            size_t read(hash_t* hashes, size_t count)
+            {
+                return std::fread(hashes, sizeof(hash_t), count, file_);
+            }
+
+        private:
+            Run(const Run& other);
+            Run& operator=(const Run& other);
+
+            std::string path_;
+            std::FILE* file_;
+        };
+
+        /**
+         * Reads a run through a buffer of fixed size.
+         */
+        class Reader {
+        public:
+            Reader(Run& run, size_t buffer)
+                : run_(run)
+                , buffer_(buffer)
+                , position_(0)
+                , size_(0)
+            {
+                run_.rewind();
+                fill();
+            }
+
+            bool done() const
+            {
+                return position_ == size_;
+            }
+
+            hash_t peek() const
+            {
+                return buffer_[position_];
+            }
+
+            void next()
+            {
+                if (++position_ == size_)
+                {
+                    fill();
+                }
+            }
+
+        private:
+            void fill()
+            {
+                size_ = run_.read(buffer_.data(), buffer_.size());
+                position_ = 0;
+            }
+
+            Run& run_;
+            std::vector<hash_t> buffer_;
+            size_t position_;
+            size_t size_;
+        };
+
+        typedef std::vector<std::unique_ptr<Run> > runs_t;
+
+        /**
+         * Merge runs, calling `consume(hash)` with each hash in order.
+         */
+        template <typename Consume>
+        void merge(runs_t::iterator begin, runs_t::iterator end, size_t buffer, Consume consume)
+        {
+            std::vector<std::unique_ptr<Reader> > readers;
+            for (auto run = begin; run != end; ++run)
+            {
+                readers.push_back(std::unique_ptr<Reader>(new Reader(**run, buffer)));
+            }
+
+            // Heap of (next hash, reader), smallest first
+            typedef std::pair<hash_t, size_t> head_t;
+            std::priority_queue<head_t, std::vector<head_t>, std::greater<head_t> > heads;
+            for (size_t i = 0; i < readers.size(); ++i)
+            {
+                if (!readers[i]->done())
+                {
+                    heads.push(std::make_pair(readers[i]->peek(), i));
+                }
+            }
+
+            while (!heads.empty())
+            {
+                head_t head = heads.top();
+                heads.pop();
+                consume(head.first);
+
+                Reader& reader = *readers[head.second];
+                reader.next();
+                if (!reader.done())
+                {
+                    heads.push(std::make_pair(reader.peek(), head.second));
+                }
+            }
+        }
+
+        /**
+         * Find the matches in a block of permuted hashes sharing a prefix, emitting
+         * only those owned by the permutation.
+         */
+        size_t check_block(const Permutation& permutation,
+                           const std::vector<hash_t>& block,
+                           std::vector<size_t>& indices,
+                           size_t different_bits,
+                           const std::function<void(const match_t&)>& emit)
+        {
+            size_t matches(0);
+            indices.resize(std::max(indices.size(), block.size()));
+            for (size_t a = 0; a + 1 < block.size(); ++a)
+            {
+                size_t found = find_within(
+                    block[a], block.data() + a + 1, block.size() - a - 1, different_bits,
+                    indices.data());
+                for (size_t i = 0; i < found; ++i)
+                {
+                    hash_t a_raw = permutation.reverse(block[a]);
+                    hash_t b_raw = permutation.reverse(block[a + 1 + indices[i]]);
+                    if (permutation.owns(a_raw, b_raw))
+                    {
+                        emit(std::make_pair(std::min(a_raw, b_raw), std::max(a_raw, b_raw)));
+                        ++matches;
+                    }
+                }
+            }
+            return matches;
+        }
+    }
+
+    size_t find_all_external(const hash_t* hashes,
+                             size_t count,
+                             size_t number_of_blocks,
+                             size_t different_bits,
+                             size_t memory_budget,
+                             const std::string& temporary_directory,
+                             const std::function<void(const match_t&)>& emit)
+    {
+        /* Chunks need room for themselves and a sort buffer, and each run being
+         * merged needs at least a minimal buffer (plus one for output). */
+        size_t chunk = memory_budget / (2 * sizeof(hash_t));
+        size_t fan_in = memory_budget / (MINIMUM_BUFFER * sizeof(hash_t));
+        if (chunk < MINIMUM_BUFFER || fan_in < 3)
+        {
+            std::stringstream message;
+            message << "Memory budget must be at least "
+                    << 3 * MINIMUM_BUFFER * sizeof(hash_t) << " bytes";
+            throw std::invalid_argument(message.str());
+        }
+        fan_in -= 1;
+
+        size_t matches(0);
+        std::vector<hash_t> buffer, scratch;
+        std::vector<hash_t> block;
+        std::vector<size_t> indices;
+        size_t tables = Permutation::count(number_of_blocks, different_bits);
+        for (size_t table = 0; table < tables; ++table)
+        {
+            Permutation permutation = Permutation::nth(number_of_blocks, different_bits, table);
+
+            // Write sorted runs of permuted hashes
+            runs_t runs;
+            buffer.resize(std::min(chunk, count));
+            scratch.resize(buffer.size());
+            for (size_t start = 0; start < count; start += chunk)
+            {
+                size_t size = std::min(chunk, count - start);
+                permutation.apply_many(hashes + start, buffer.data(), size);
+                radix_sort(buffer.data(), scratch.data(), size);
+                runs.push_back(std::unique_ptr<Run>(new Run(temporary_directory)));
+                runs.back()->write(buffer.data(), size);
+            }
+            std::vector<hash_t>().swap(buffer);
+            std::vector<hash_t>().swap(scratch);
+
+            // Merge groups of runs until they can all be merged at once
+            while (runs.size() > fan_in)
+            {
+                runs_t merged;
+                for (size_t start = 0; start < runs.size(); start += fan_in)
+                {
+                    size_t end = std::min(start + fan_in, runs.size());
+                    size_t reader_buffer = memory_budget / ((end - start + 1) * sizeof(hash_t));
+                    merged.push_back(std::unique_ptr<Run>(new Run(temporary_directory)));
+                    Run& output = *merged.back();
+                    std::vector<hash_t> pending;
+                    pending.reserve(reader_buffer);
+                    merge(runs.begin() + start, runs.begin() + end, reader_buffer,
+                        [&](hash_t hash) {
+                            pending.push_back(hash);
+                            if (pending.size() == reader_buffer)
+                            {
+                                output.write(pending.data(), pending.size());
+                                pending.clear();
+                            }
+                        });
+                    output.write(pending.data(), pending.size());
+                }
+                runs.swap(merged);
+            }
+
+            /* Stream through the merged runs, collecting each block of hashes
+             * sharing a prefix. Duplicates in the input are adjacent, so skip
+             * them here. */
+            hash_t mask = permutation.search_mask();
+            size_t reader_buffer = memory_budget / ((runs.size() + 1) * sizeof(hash_t));
+            block.clear();
+            merge(runs.begin(), runs.end(), reader_buffer, [&](hash_t hash) {
+                if (!block.empty() && (block.back() & mask) != (hash & mask))
+                {
+                    matches += check_block(permutation, block, indices, different_bits, emit);
+                    block.clear();
+                }
+                if (block.empty() || block.back() != hash)
+                {
+                    block.push_back(hash);
+                }
+            });
+            matches += check_block(permutation, block, indices, different_bits, emit);
+        }
+        return matches;
+    }
+}
@@ -0,0 +1,289 @@
+#include "index.h"
+#include "sort.h"
+#include "tables.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace Simhash {
+
+    Index::Index(size_t number_of_blocks, size_t different_bits, size_t directory_bits)
+        : number_of_blocks_(number_of_blocks)
+        , different_bits_(different_bits)
+        , directory_bits_(directory_bits)
+        , permutations_(Permutation::create(number_of_blocks, different_bits))
+        , tables_(permutations_.size())
+    {
+        if (directory_bits > MAX_DIRECTORY_BITS)
+        {
+            std::stringstream message;
+            message << "Directory bits (" << directory_bits
+                    << ") must be at most " << MAX_DIRECTORY_BITS;
+            throw std::invalid_argument(message.str());
+        }
+
+        if (directory_bits_)
+        {
+            directories_.assign(
+                tables_.size(), std::vector<uint64_t>(directory_size(directory_bits_), 0));
+        }
+    }
+
+    Index::Index(const Index& other)
+        : number_of_blocks_(other.number_of_blocks_)
+        , different_bits_(other.different_bits_)
+        , directory_bits_(other.directory_bits_)
+        , permutations_(other.permutations_)
+        , tables_(other.tables_)
+        , directories_(other.directories_)
+        , encoded_(other.encoded_)
+        , views_()
+    {
+        for (const std::vector<uint64_t>& encoded : encoded_)
+        {
+            views_.push_back(EliasFano(encoded.data(), encoded.size()));
+        }
+    }
+
+    Index& Index::operator=(const Index& other)
+    {
+        Index copy(other);
+        *this = std::move(copy);
+        return *this;
+    }
+
+    bool Index::insert(hash_t hash)
+    {
+        if (contains(hash))
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < tables_.size(); ++i)
+        {
+            hash_t permuted = permutations_[i].apply(hash);
+            std::vector<hash_t>& table = open_table(i);
+            table.insert(
+                std::lower_bound(table.begin(), table.end(), permuted), permuted);
+            close_table(i);
+        }
+        shift_directories(hash, 1);
+        return true;
+    }
+
+    void Index::insert(const std::vector<hash_t>& hashes)
+    {
+        insert(hashes.data(), hashes.size());
+    }
+
+    void Index::insert(const hash_t* hashes, size_t count)
+    {
+        std::vector<hash_t> scratch(count);
+        for (size_t i = 0; i < tables_.size(); ++i)
+        {
+            const Permutation& permutation = permutations_[i];
+            std::vector<hash_t>& table = open_table(i);
+
+            // Append the permuted hashes, sort them, and merge them into the
+            // already-sorted portion of the table.
+            size_t existing = table.size();
+            table.resize(existing + count);
+            permutation.apply_many(hashes, table.data() + existing, count);
+            radix_sort(table.data() + existing, scratch.data(), count);
+            std::inplace_merge(table.begin(), table.begin() + existing, table.end());
+
+            // Permutations are bijections, so duplicates are the same in every table
+            table.erase(std::unique(table.begin(), table.end()), table.end());
+
+            if (!directories_.empty())
+            {
+                build_directory(table.data(), table.size(), directory_bits_, directories_[i].data());
+            }
+            close_table(i);
+        }
+    }
+
+    bool Index::remove(hash_t hash)
+    {
+        if (!contains(hash))
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < tables_.size(); ++i)
+        {
+            hash_t permuted = permutations_[i].apply(hash);
+            std::vector<hash_t>& table = open_table(i);
+            table.erase(std::lower_bound(table.begin(), table.end(), permuted));
+            close_table(i);
+        }
+        shift_directories(hash, -1);
+        return true;
+    }
+
+    void Index::compress()
+    {
+        if (compressed())
+        {
+            return;
+        }
+
+        encoded_.resize(tables_.size());
+        for (size_t i = 0; i < tables_.size(); ++i)
+        {
+            encoded_[i] = EliasFano::encode(tables_[i].data(), tables_[i].size());
+            views_.push_back(EliasFano(encoded_[i].data(), encoded_[i].size()));
+            std::vector<hash_t>().swap(tables_[i]);
+        }
+        std::vector<std::vector<uint64_t> >().swap(directories_);
+    }
+
+    bool Index::compressed() const
+    {
+        return !encoded_.empty();
+    }
+
+    std::vector<hash_t>& Index::open_table(size_t i)
+    {
+        if (compressed())
+        {
+            tables_[i].resize(views_[i].size());
+            views_[i].decode(tables_[i].data());
+        }
+        return tables_[i];
+    }
+
+    void Index::close_table(size_t i)
+    {
+        if (compressed())
+        {
+            encoded_[i] = EliasFano::encode(tables_[i].data(), tables_[i].size());
+            views_[i] = EliasFano(encoded_[i].data(), encoded_[i].size());
+            std::vector<hash_t>().swap(tables_[i]);
+        }
+    }
+
+    void Index::shift_directories(hash_t hash, int delta)
+    {
+        // Every bucket after the hash's own begins one place later (or earlier)
+        for (size_t i = 0; i < directories_.size(); ++i)
+        {
+            std::vector<uint64_t>& directory = directories_[i];
+            size_t bucket = permutations_[i].apply(hash) >> (BITS - directory_bits_);
+            for (size_t j = bucket + 1; j < directory.size(); ++j)
+            {
+                directory[j] += delta;
+            }
+        }
+    }
+
+    bool Index::contains(hash_t hash) const
+    {
+        std::vector<hash_t> scratch;
+        hash_t permuted = permutations_[0].apply(hash);
+        return table(0).range(permuted, permuted, scratch).second != 0;
+    }
+
+    std::vector<hash_t> Index::find(hash_t query) const
+    {
+        return find_in_tables(permutations_, tables(), different_bits_, query);
+    }
+
+    sorted_matches_t Index::probe(const hash_t* queries, size_t count, size_t threads) const
+    {
+        return probe_tables(permutations_, tables(), different_bits_, queries, count, threads);
+    }
+
+    BatchResults Index::find_batch(const hash_t* queries, size_t count, size_t threads) const
+    {
+        ThreadPool pool(threads);
+        return find_batch(queries, count, pool);
+    }
+
+    BatchResults Index::find_batch(const hash_t* queries, size_t count, ThreadPool& pool) const
+    {
+        return find_batch_in_tables(
+            permutations_, tables(), different_bits_, queries, count, pool);
+    }
+
+    std::vector<Neighbor> Index::nearest(hash_t query, size_t k) const
+    {
+        return nearest_in_tables(
+            permutations_, tables(), number_of_blocks_, different_bits_, query, k);
+    }
+
+    std::vector<size_t> Index::histogram(hash_t query) const
+    {
+        return histogram_in_tables(permutations_, tables(), different_bits_, query);
+    }
+
+    size_t Index::size() const
+    {
+        return compressed() ? views_[0].size() : tables_[0].size();
+    }
+
+    size_t Index::number_of_blocks() const
+    {
+        return number_of_blocks_;
+    }
+
+    size_t Index::different_bits() const
+    {
+        return different_bits_;
+    }
+
+    size_t Index::directory_bits() const
+    {
+        return directories_.empty() ? 0 : directory_bits_;
+    }
+
+    size_t Index::directory_bytes() const
+    {
+        return directories_.size() * directory_size(directory_bits_) * sizeof(uint64_t);
+    }
+
+    size_t Index::table_bytes() const
+    {
+        size_t words(0);
+        for (size_t i = 0; i < tables_.size(); ++i)
+        {
+            words += compressed() ? encoded_[i].size() : tables_[i].size();
+        }
+        return words * sizeof(uint64_t);
+    }
+
+    const std::vector<Permutation>& Index::permutations() const
+    {
+        return permutations_;
+    }
+
+    std::vector<Table> Index::tables() const
+    {
+        std::vector<Table> views;
+        for (size_t i = 0; i < tables_.size(); ++i)
+        {
+            views.push_back(table(i));
+        }
+        return views;
+    }
+
+    Table Index::table(size_t i) const
+    {
+        if (compressed())
+        {
+            Table view = { nullptr, views_[i].size(), nullptr, 0, nullptr, 0, &views_[i] };
+            return view;
+        }
+
+        Table view = { tables_[i].data(), tables_[i].size(), nullptr, 0, nullptr, 0, nullptr };
+        if (!directories_.empty())
+        {
+            view.directory = directories_[i].data();
+            view.directory_bits = directory_bits_;
+        }
+        return view;
+    }
+}
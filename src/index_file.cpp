@@ -0,0 +1,325 @@
+#include "index_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace Simhash {
+
+    namespace {
+
+        /* "SIMHASHI" as a little-endian uint64. */
+        const uint64_t MAGIC = 0x49485341484D4953ULL;
+
+        /* How the hashes of each table are stored. */
+        const uint64_t PLAIN = 0;
+        const uint64_t ELIAS_FANO = 1;
+
+        /* The number of uint64 values in the header. */
+        const size_t HEADER = 9;
+
+        size_t samples(size_t size, size_t stride)
+        {
+            return stride ? (size + stride - 1) / stride : 0;
+        }
+
+        void invalid(const std::string& path, const std::string& reason)
+        {
+            throw std::runtime_error(path + " is not a valid index: " + reason);
+        }
+    }
+
+    void write_index(const Index& index, const std::string& path, size_t stride)
+    {
+        std::ofstream stream(path, std::ofstream::binary);
+        {
+            Writer writer(stream);
+            std::vector<Table> tables = index.tables();
+            writer.binary(MAGIC);
+            writer.binary(MappedIndex::VERSION);
+            writer.binary(index.number_of_blocks());
+            writer.binary(index.different_bits());
+            writer.binary(tables.size());
+            writer.binary(index.size());
+            bool compressed = index.compressed();
+            stride = compressed ? 0 : stride;
+            writer.binary(stride);
+            writer.binary(index.directory_bits());
+            writer.binary(static_cast<uint64_t>(compressed ? ELIAS_FANO : PLAIN));
+
+            for (const Permutation& permutation : index.permutations())
+            {
+                for (hash_t mask : permutation.masks())
+                {
+                    writer.binary(mask);
+                }
+            }
+
+            for (const Table& table : tables)
+            {
+                if (table.compressed)
+                {
+                    writer.binary(table.compressed->length());
+                    for (size_t i = 0; i < table.compressed->length(); ++i)
+                    {
+                        writer.binary(table.compressed->words()[i]);
+                    }
+                    continue;
+                }
+
+                for (size_t i = 0; table.directory && i < directory_size(table.directory_bits); ++i)
+                {
+                    writer.binary(table.directory[i]);
+                }
+                for (size_t i = 0; i < samples(table.size, stride); ++i)
+                {
+                    writer.binary(table.data[i * stride]);
+                }
+                for (size_t i = 0; i < table.size; ++i)
+                {
+                    writer.binary(table.data[i]);
+                }
+            }
+        }
+
+        stream.close();
+        if (!stream)
+        {
+            throw std::runtime_error("Could not write " + path);
+        }
+    }
+
+    bool is_index_file(const std::string& path)
+    {
+        std::ifstream stream(path, std::ifstream::binary);
+        unsigned char bytes[sizeof(MAGIC)];
+        if (!stream.read(reinterpret_cast<char*>(bytes), sizeof(bytes)))
+        {
+            return false;
+        }
+
+        uint64_t magic(0);
+        for (size_t i = 0; i < sizeof(bytes); ++i)
+        {
+            magic |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+        }
+        return magic == MAGIC;
+    }
+
+    const uint64_t MappedIndex::VERSION;
+
+    MappedIndex::MappedIndex(const std::string& path)
+        : file_(path, false)
+        , number_of_blocks_(0)
+        , different_bits_(0)
+        , size_(0)
+        , permutations_()
+        , compressed_()
+        , tables_()
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        invalid(path, "only little-endian hosts can use index files in place");
+#endif
+        const hash_t* words = reinterpret_cast<const hash_t*>(file_.data());
+        size_t length = file_.size() / sizeof(hash_t);
+        if (length < 2 || words[0] != MAGIC)
+        {
+            invalid(path, "bad header");
+        }
+        if (words[1] != VERSION)
+        {
+            std::stringstream message;
+            message << "unsupported version " << words[1];
+            invalid(path, message.str());
+        }
+        if (length < HEADER)
+        {
+            invalid(path, "bad header");
+        }
+        number_of_blocks_ = words[2];
+        different_bits_ = words[3];
+        size_t number_of_tables = words[4];
+        size_ = words[5];
+        size_t stride = words[6];
+        size_t directory_bits = words[7];
+        uint64_t encoding = words[8];
+
+        // Check the file has room for everything before going any further
+        if (number_of_blocks_ > BITS || different_bits_ >= number_of_blocks_ ||
+            number_of_tables == 0 || size_ > length ||
+            directory_bits > MAX_DIRECTORY_BITS || encoding > ELIAS_FANO ||
+            (encoding == ELIAS_FANO && (stride || directory_bits)) ||
+            number_of_blocks_ > (length - HEADER) / number_of_tables)
+        {
+            invalid(path, "bad header");
+        }
+        size_t directory = directory_bits ? directory_size(directory_bits) : 0;
+        size_t per_table = number_of_blocks_ + directory + samples(size_, stride) + size_;
+        if ((encoding == PLAIN && (per_table > (length - HEADER) / number_of_tables ||
+                                   HEADER + number_of_tables * per_table != length)) ||
+            file_.size() % sizeof(hash_t) != 0)
+        {
+            std::stringstream message;
+            message << "expected " << number_of_tables << " tables of " << size_
+                    << " hashes in " << file_.size() << " bytes";
+            invalid(path, message.str());
+        }
+
+        // Searches rely on the tables being exactly those of Permutation::create,
+        // in the same order, so any other masks are rejected before they're used
+        if (number_of_tables != Permutation::count(number_of_blocks_, different_bits_))
+        {
+            invalid(path, "bad masks");
+        }
+        const hash_t* position = words + HEADER;
+        for (size_t i = 0; i < number_of_tables; ++i)
+        {
+            Permutation permutation = Permutation::nth(number_of_blocks_, different_bits_, i);
+            std::vector<hash_t> masks(permutation.masks());
+            if (!std::equal(masks.begin(), masks.end(), position))
+            {
+                invalid(path, "bad masks");
+            }
+            permutations_.push_back(permutation);
+            position += number_of_blocks_;
+        }
+
+        if (encoding == ELIAS_FANO)
+        {
+            // Each table is its length in words, and then its encoding
+            const hash_t* end = words + length;
+            compressed_.reserve(number_of_tables);
+            for (size_t i = 0; i < number_of_tables; ++i)
+            {
+                if (position == end || *position > static_cast<size_t>(end - position - 1))
+                {
+                    invalid(path, "truncated table");
+                }
+                try
+                {
+                    compressed_.push_back(EliasFano(position + 1, *position));
+                }
+                catch (const std::invalid_argument& error)
+                {
+                    invalid(path, error.what());
+                }
+                if (compressed_.back().size() != size_)
+                {
+                    invalid(path, "tables differ in size");
+                }
+                Table table = { nullptr, size_, nullptr, 0, nullptr, 0, &compressed_.back() };
+                tables_.push_back(table);
+                position += 1 + *position;
+            }
+            if (position != end)
+            {
+                invalid(path, "trailing data");
+            }
+            return;
+        }
+
+        for (size_t i = 0; i < number_of_tables; ++i)
+        {
+            const hash_t* offsets = position;
+            position += directory;
+
+            // A directory that runs off the end of the table would make
+            // searches read past it, so it must be checked in full: it starts
+            // at 0, never decreases, and ends at the size of the table.
+            if (directory && (offsets[0] != 0 || offsets[directory - 1] != size_))
+            {
+                invalid(path, "bad prefix directory");
+            }
+            for (size_t j = 1; j < directory; ++j)
+            {
+                if (offsets[j] < offsets[j - 1])
+                {
+                    invalid(path, "bad prefix directory");
+                }
+            }
+
+            Table table = { position + samples(size_, stride), size_,
+                            stride ? position : nullptr, stride,
+                            directory ? offsets : nullptr, directory_bits, nullptr };
+            tables_.push_back(table);
+            position = table.data + size_;
+        }
+    }
+
+    bool MappedIndex::contains(hash_t hash) const
+    {
+        std::vector<hash_t> scratch;
+        hash_t permuted = permutations_[0].apply(hash);
+        return tables_[0].range(permuted, permuted, scratch).second != 0;
+    }
+
+    std::vector<hash_t> MappedIndex::find(hash_t query) const
+    {
+        return find_in_tables(permutations_, tables_, different_bits_, query);
+    }
+
+    sorted_matches_t MappedIndex::probe(const hash_t* queries, size_t count, size_t threads) const
+    {
+        return probe_tables(permutations_, tables_, different_bits_, queries, count, threads);
+    }
+
+    BatchResults MappedIndex::find_batch(const hash_t* queries, size_t count, size_t threads) const
+    {
+        ThreadPool pool(threads);
+        return find_batch(queries, count, pool);
+    }
+
+    BatchResults MappedIndex::find_batch(const hash_t* queries, size_t count, ThreadPool& pool) const
+    {
+        return find_batch_in_tables(
+            permutations_, tables_, different_bits_, queries, count, pool);
+    }
+
+    std::vector<Neighbor> MappedIndex::nearest(hash_t query, size_t k) const
+    {
+        return nearest_in_tables(
+            permutations_, tables_, number_of_blocks_, different_bits_, query, k);
+    }
+
+    std::vector<size_t> MappedIndex::histogram(hash_t query) const
+    {
+        return histogram_in_tables(permutations_, tables_, different_bits_, query);
+    }
+
+    size_t MappedIndex::size() const
+    {
+        return size_;
+    }
+
+    size_t MappedIndex::directory_bits() const
+    {
+        return tables_[0].directory_bits;
+    }
+
+    bool MappedIndex::compressed() const
+    {
+        return !compressed_.empty();
+    }
+
+    size_t MappedIndex::number_of_blocks() const
+    {
+        return number_of_blocks_;
+    }
+
+    size_t MappedIndex::different_bits() const
+    {
+        return different_bits_;
+    }
+
+    const std::vector<Permutation>& MappedIndex::permutations() const
+    {
+        return permutations_;
+    }
+
+    const std::vector<Table>& MappedIndex::tables() const
+    {
+        return tables_;
+    }
+}
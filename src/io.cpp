@@ -0,0 +1,480 @@
+#include "io.h"
+
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Simhash {
+
+    namespace {
+
+        /* The two-digit decimal representations of 0 through 99. */
+        const char DIGIT_PAIRS[] =
+            "00010203040506070809"
+            "10111213141516171819"
+            "20212223242526272829"
+            "30313233343536373839"
+            "40414243444546474849"
+            "50515253545556575859"
+            "60616263646566676869"
+            "70717273747576777879"
+            "80818283848586878889"
+            "90919293949596979899";
+
+        bool little_endian()
+        {
+            const uint16_t probe(1);
+            return *reinterpret_cast<const unsigned char*>(&probe) == 1;
+        }
+
+        hash_t swap_bytes(hash_t hash)
+        {
+            return __builtin_bswap64(hash);
+        }
+
+        /**
+         * Whether the path is a regular file, which can be mapped. Paths that
+         * can't be inspected count as regular, so that mapping them reports
+         * the error.
+         */
+        bool regular_file(const std::string& path)
+        {
+            struct stat status;
+            return stat(path.c_str(), &status) != 0 || S_ISREG(status.st_mode);
+        }
+
+        /**
+         * Read all of a stream of hashes, named `name` in errors, into hashes.
+         */
+        void read_hashes(std::istream& stream,
+                         const std::string& name,
+                         format_t format,
+                         std::vector<hash_t>& hashes)
+        {
+            std::string contents(
+                (std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+            if (stream.bad())
+            {
+                throw std::runtime_error("Could not read " + name);
+            }
+            if (format == FORMAT_TEXT)
+            {
+                parse_hashes(contents.data(), contents.data() + contents.size(), hashes);
+            }
+            else
+            {
+                if (contents.size() % sizeof(hash_t))
+                {
+                    throw std::runtime_error(name + " is not a whole number of hashes.");
+                }
+                hashes.resize(contents.size() / sizeof(hash_t));
+                std::memcpy(hashes.data(), contents.data(), contents.size());
+            }
+        }
+    }
+
+    format_t parse_format(const std::string& name)
+    {
+        if (name == "text")
+        {
+            return FORMAT_TEXT;
+        }
+        if (name == "binary")
+        {
+            return FORMAT_BINARY;
+        }
+        throw std::invalid_argument("Unknown format: " + name);
+    }
+
+    MappedFile::MappedFile(const std::string& path, bool sequential)
+        : data_(nullptr)
+        , size_(0)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Could not open " + path);
+        }
+
+        struct stat status;
+        if (fstat(fd, &status) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Could not stat " + path);
+        }
+        if (!S_ISREG(status.st_mode))
+        {
+            close(fd);
+            throw std::runtime_error(path + " is not a regular file");
+        }
+
+        // Empty files can't be mapped, but there's nothing to map anyway
+        size_ = static_cast<size_t>(status.st_size);
+        if (size_ > 0)
+        {
+            void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                close(fd);
+                throw std::runtime_error("Could not map " + path);
+            }
+            data_ = static_cast<const char*>(data);
+            madvise(data, size_, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        }
+        close(fd);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (data_)
+        {
+            munmap(const_cast<char*>(data_), size_);
+        }
+    }
+
+    const char* MappedFile::data() const
+    {
+        return data_;
+    }
+
+    size_t MappedFile::size() const
+    {
+        return size_;
+    }
+
+    void parse_hashes(const char* begin, const char* end, std::vector<hash_t>& hashes)
+    {
+        const hash_t limit = ~static_cast<hash_t>(0);
+        const char* it = begin;
+        while (true)
+        {
+            // Skip the whitespace between hashes
+            while (it != end && (*it == '\n' || *it == '\r' || *it == ' ' || *it == '\t'))
+            {
+                ++it;
+            }
+            if (it == end)
+            {
+                return;
+            }
+
+            const char* start = it;
+            hash_t hash(0);
+            for (; it != end && *it >= '0' && *it <= '9'; ++it)
+            {
+                hash_t digit = static_cast<hash_t>(*it - '0');
+                if (hash > (limit - digit) / 10)
+                {
+                    throw std::out_of_range(
+                        "Hash out of range: " + std::string(start, it - start + 1));
+                }
+                hash = hash * 10 + digit;
+            }
+
+            if (it == start || (it != end && *it != '\n' && *it != '\r' &&
+                                *it != ' ' && *it != '\t'))
+            {
+                std::stringstream message;
+                message << "Invalid hash at offset " << (it - begin);
+                throw std::invalid_argument(message.str());
+            }
+            hashes.push_back(hash);
+        }
+    }
+
+    char* format_hash(hash_t hash, char* buffer)
+    {
+        // Write the digits backwards, two at a time, into a scratch buffer
+        char digits[20];
+        char* it = digits + sizeof(digits);
+        while (hash >= 100)
+        {
+            size_t pair = static_cast<size_t>(hash % 100) * 2;
+            hash /= 100;
+            *--it = DIGIT_PAIRS[pair + 1];
+            *--it = DIGIT_PAIRS[pair];
+        }
+        if (hash >= 10)
+        {
+            size_t pair = static_cast<size_t>(hash) * 2;
+            *--it = DIGIT_PAIRS[pair + 1];
+            *--it = DIGIT_PAIRS[pair];
+        }
+        else
+        {
+            *--it = static_cast<char>('0' + hash);
+        }
+
+        size_t length = digits + sizeof(digits) - it;
+        std::memcpy(buffer, it, length);
+        return buffer + length;
+    }
+
+    InputHashes::InputHashes(const std::string& path, format_t format)
+        : file_()
+        , hashes_()
+        , data_(nullptr)
+        , size_(0)
+    {
+        if (path == "-")
+        {
+            read_hashes(std::cin, "Binary input", format, hashes_);
+        }
+        else if (!regular_file(path))
+        {
+            // Pipes have no size up front, so they're read like stdin
+            std::ifstream stream(path, std::ifstream::binary);
+            if (!stream)
+            {
+                throw std::runtime_error("Could not open " + path);
+            }
+            read_hashes(stream, path, format, hashes_);
+        }
+        else
+        {
+            std::unique_ptr<MappedFile> file(new MappedFile(path));
+            if (format == FORMAT_TEXT)
+            {
+                parse_hashes(file->data(), file->data() + file->size(), hashes_);
+            }
+            else
+            {
+                if (file->size() % sizeof(hash_t))
+                {
+                    throw std::runtime_error(path + " is not a whole number of hashes.");
+                }
+                file_ = std::move(file);
+            }
+        }
+
+        if (file_ && little_endian())
+        {
+            // Use the mapping in place
+            data_ = reinterpret_cast<const hash_t*>(file_->data());
+            size_ = file_->size() / sizeof(hash_t);
+            return;
+        }
+
+        if (file_)
+        {
+            hashes_.resize(file_->size() / sizeof(hash_t));
+            std::memcpy(hashes_.data(), file_->data(), file_->size());
+            file_.reset();
+        }
+        if (format == FORMAT_BINARY && !little_endian())
+        {
+            for (hash_t& hash : hashes_)
+            {
+                hash = swap_bytes(hash);
+            }
+        }
+        data_ = hashes_.data();
+        size_ = hashes_.size();
+    }
+
+    const hash_t* InputHashes::data() const
+    {
+        return data_;
+    }
+
+    size_t InputHashes::size() const
+    {
+        return size_;
+    }
+
+    Writer::Writer(std::ostream& stream)
+        : stream_(stream)
+        , size_(0)
+    {}
+
+    Writer::~Writer()
+    {
+        flush();
+    }
+
+    bool Writer::good() const
+    {
+        return stream_.good();
+    }
+
+    void Writer::text(const char* value, size_t length)
+    {
+        reserve(length);
+        std::memcpy(buffer_ + size_, value, length);
+        size_ += length;
+    }
+
+    void Writer::decimal(hash_t hash)
+    {
+        reserve(20);
+        size_ = format_hash(hash, buffer_ + size_) - buffer_;
+    }
+
+    void Writer::binary(hash_t hash)
+    {
+        reserve(sizeof(hash));
+        if (!little_endian())
+        {
+            hash = swap_bytes(hash);
+        }
+        std::memcpy(buffer_ + size_, &hash, sizeof(hash));
+        size_ += sizeof(hash);
+    }
+
+    void Writer::flush()
+    {
+        if (size_ && stream_.good())
+        {
+            stream_.write(buffer_, size_);
+        }
+        size_ = 0;
+        stream_.flush();
+    }
+
+    void Writer::reserve(size_t length)
+    {
+        if (size_ + length > sizeof(buffer_))
+        {
+            flush();
+        }
+    }
+
+    void write_match(Writer& writer, const match_t& match, format_t format, bool distances)
+    {
+        if (format == FORMAT_TEXT)
+        {
+            writer.text("[", 1);
+            writer.decimal(match.first);
+            writer.text(", ", 2);
+            writer.decimal(match.second);
+            if (distances)
+            {
+                writer.text(", ", 2);
+                writer.decimal(num_differing_bits(match.first, match.second));
+            }
+            writer.text("]\n", 2);
+        }
+        else
+        {
+            writer.binary(match.first);
+            writer.binary(match.second);
+            if (distances)
+            {
+                writer.binary(num_differing_bits(match.first, match.second));
+            }
+        }
+    }
+
+    void write_matches(std::ostream& stream,
+                       const sorted_matches_t& matches,
+                       format_t format,
+                       bool distances)
+    {
+        Writer writer(stream);
+        for (auto it = matches.begin(); it != matches.end() && writer.good(); ++it)
+        {
+            write_match(writer, *it, format, distances);
+        }
+    }
+
+    size_t merge_matches(const std::vector<std::string>& paths,
+                         std::ostream& stream,
+                         format_t format,
+                         bool distances)
+    {
+        size_t record = (distances ? 3 : 2) * sizeof(hash_t);
+        std::vector<std::unique_ptr<MappedFile> > files;
+        for (const std::string& path : paths)
+        {
+            files.emplace_back(new MappedFile(path));
+            if (files.back()->size() % record)
+            {
+                throw std::runtime_error(path + " is not a whole number of matches.");
+            }
+        }
+
+        auto decode = [](const char* data) {
+            hash_t hash;
+            std::memcpy(&hash, data, sizeof(hash));
+            return little_endian() ? hash : swap_bytes(hash);
+        };
+
+        // The next match from each file, least first, with the file it came from
+        typedef std::pair<match_t, size_t> entry_t;
+        std::priority_queue<entry_t, std::vector<entry_t>, std::greater<entry_t> > heap;
+        std::vector<size_t> offsets(files.size(), 0);
+        auto advance = [&](size_t i, const match_t& previous) {
+            if (offsets[i] == files[i]->size())
+            {
+                return;
+            }
+            const char* data = files[i]->data() + offsets[i];
+            match_t match(decode(data), decode(data + sizeof(hash_t)));
+            if (offsets[i] > 0 && match < previous)
+            {
+                throw std::runtime_error(paths[i] + " is not sorted.");
+            }
+            offsets[i] += record;
+            heap.push(std::make_pair(match, i));
+        };
+
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            advance(i, match_t());
+        }
+
+        Writer writer(stream);
+        size_t written(0);
+        match_t last;
+        while (!heap.empty() && writer.good())
+        {
+            entry_t top = heap.top();
+            heap.pop();
+            const match_t& match = top.first;
+            advance(top.second, match);
+            if (written == 0 || match != last)
+            {
+                write_match(writer, match, format, distances);
+                last = match;
+                ++written;
+            }
+        }
+        return written;
+    }
+
+    void write_clusters(std::ostream& stream, const clusters_t& clusters, format_t format)
+    {
+        Writer writer(stream);
+        for (auto cluster = clusters.begin(); cluster != clusters.end() && writer.good(); ++cluster)
+        {
+            if (format == FORMAT_TEXT)
+            {
+                const char* separator = "[";
+                for (hash_t hash : *cluster)
+                {
+                    writer.text(separator, std::strlen(separator));
+                    writer.decimal(hash);
+                    separator = ", ";
+                }
+                writer.text("]\n", 2);
+            }
+            else
+            {
+                writer.binary(cluster->size());
+                for (hash_t hash : *cluster)
+                {
+                    writer.binary(hash);
+                }
+            }
+        }
+    }
+}
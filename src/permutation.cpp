@@ -1,67 +1,215 @@
 #include "permutation.h"
+#include "cpu.h"
 
 #include <algorithm>
 #include <sstream>
 #include <stdexcept>
 #include <vector>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 namespace Simhash {
 
-    std::vector<std::vector<hash_t> > Permutation::choose(
-            const std::vector<hash_t>& population, size_t r)
+    namespace {
+
+#if defined(__x86_64__) || defined(__i386__)
+        /* These kernels permute a whole vector of hashes at a time. Every hash
+         * moves each block by the same amount, so each block takes an and and
+         * two uniform shifts per vector. They return how many of the hashes
+         * they've handled; the remainder is left to the scalar code. */
+        __attribute__((target("avx2")))
+        size_t apply_avx2(const Permutation::Block* moves,
+                          size_t blocks,
+                          const hash_t* input,
+                          hash_t* output,
+                          size_t count)
+        {
+            __m256i vector_masks[Simhash::BITS];
+            __m128i lefts[Simhash::BITS], rights[Simhash::BITS];
+            for (size_t i = 0; i < blocks; ++i)
+            {
+                vector_masks[i] = _mm256_set1_epi64x(static_cast<long long>(moves[i].forward_mask));
+                lefts[i] = _mm_cvtsi32_si128(moves[i].left_shift);
+                rights[i] = _mm_cvtsi32_si128(moves[i].right_shift);
+            }
+
+            size_t done(0);
+            for (; done + 4 <= count; done += 4)
+            {
+                __m256i hashes = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(input + done));
+                __m256i result = _mm256_setzero_si256();
+                for (size_t i = 0; i < blocks; ++i)
+                {
+                    __m256i block = _mm256_and_si256(hashes, vector_masks[i]);
+                    block = _mm256_srl_epi64(_mm256_sll_epi64(block, lefts[i]), rights[i]);
+                    result = _mm256_or_si256(result, block);
+                }
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + done), result);
+            }
+            return done;
+        }
+
+        __attribute__((target("avx512f")))
+        size_t apply_avx512(const Permutation::Block* moves,
+                            size_t blocks,
+                            const hash_t* input,
+                            hash_t* output,
+                            size_t count)
+        {
+            __m512i vector_masks[Simhash::BITS];
+            __m128i lefts[Simhash::BITS], rights[Simhash::BITS];
+            for (size_t i = 0; i < blocks; ++i)
+            {
+                vector_masks[i] = _mm512_set1_epi64(static_cast<long long>(moves[i].forward_mask));
+                lefts[i] = _mm_cvtsi32_si128(moves[i].left_shift);
+                rights[i] = _mm_cvtsi32_si128(moves[i].right_shift);
+            }
+
+            const __mmask8 all(0xFF);
+            size_t done(0);
+            for (; done + 8 <= count; done += 8)
+            {
+                __m512i hashes = _mm512_loadu_si512(input + done);
+                __m512i result = _mm512_setzero_si512();
+                for (size_t i = 0; i < blocks; ++i)
+                {
+                    // The zero-masking forms are used only because GCC warns about
+                    // the undefined passthrough in the unmasked ones.
+                    __m512i block = _mm512_and_si512(hashes, vector_masks[i]);
+                    block = _mm512_maskz_sll_epi64(all, block, lefts[i]);
+                    block = _mm512_maskz_srl_epi64(all, block, rights[i]);
+                    result = _mm512_or_si512(result, block);
+                }
+                _mm512_storeu_si512(output + done, result);
+            }
+            return done;
+        }
+#else
+        size_t apply_avx2(const Permutation::Block*, size_t, const hash_t*, hash_t*, size_t)
+        {
+            return 0;
+        }
+
+        size_t apply_avx512(const Permutation::Block*, size_t, const hash_t*, hash_t*, size_t)
+        {
+            return 0;
+        }
+#endif
+    }
+
+    Combinations::Combinations(size_t n, size_t r, size_t rank)
+        : n_(n)
+        , r_(r)
+        , done_(false)
+        , indices_()
     {
-        // This algorithm is cribbed from python's itertools page.
-        size_t n = population.size();
         if (r > n)
         {
             throw std::invalid_argument("R cannot be greater than population size.");
         }
+        if (n > BITS)
+        {
+            std::stringstream message;
+            message << "Population size must not exceed " << BITS;
+            throw std::invalid_argument(message.str());
+        }
+        if (rank >= count(n, r))
+        {
+            std::stringstream message;
+            message << "There are only " << count(n, r) << " combinations of "
+                    << r << " of " << n;
+            throw std::invalid_argument(message.str());
+        }
 
-        std::vector<size_t> indices(r);
-        for (size_t i = 0; i < r; ++i)
+        /* Each index is the smallest for which the combinations starting
+         * with the indices so far and it outnumber the remaining rank. */
+        size_t value(0);
+        for (size_t k = 0; k < r; ++k, ++value)
         {
-            indices[i] = i;
+            for (size_t skipped; rank >= (skipped = count(n - value - 1, r - k - 1)); ++value)
+            {
+                rank -= skipped;
+            }
+            indices_[k] = static_cast<uint8_t>(value);
         }
+    }
 
-        std::vector<std::vector<hash_t> > results;
-        std::vector<hash_t> result(r);
+    size_t Combinations::count(size_t n, size_t r)
+    {
+        if (r > n)
+        {
+            return 0;
+        }
 
+        // Each partial product is itself a binomial coefficient, so divides exactly
+        r = std::min(r, n - r);
+        unsigned __int128 result(1);
         for (size_t i = 0; i < r; ++i)
         {
-            result[i] = population[indices[i]];
+            result = result * (n - i) / (i + 1);
         }
-        results.push_back(result);
+        return static_cast<size_t>(result);
+    }
 
-        while (true)
+    bool Combinations::done() const
+    {
+        return done_;
+    }
+
+    void Combinations::next()
+    {
+        // This algorithm is cribbed from python's itertools page.
+        size_t i = r_;
+        for (; i > 0; --i)
         {
-            int i = r - 1;
-            for (; i >= 0; --i)
-            {
-                if (indices[i] != i + n - r)
-                {
-                    break;
-                }
-            }
-            if (i < 0)
+            if (indices_[i - 1] != i - 1 + n_ - r_)
             {
-                return results;
+                break;
             }
+        }
+        if (i == 0)
+        {
+            done_ = true;
+            return;
+        }
 
-            indices[i] += 1;
-            for (size_t j = i + 1; j < r; ++j)
-            {
-                indices[j] = indices[j-1] + 1;
-            }
-            for (size_t j = 0; j < r; ++j)
+        indices_[i - 1] += 1;
+        for (size_t j = i; j < r_; ++j)
+        {
+            indices_[j] = indices_[j - 1] + 1;
+        }
+    }
+
+    const uint8_t* Combinations::indices() const
+    {
+        return indices_.data();
+    }
+
+    size_t Combinations::size() const
+    {
+        return r_;
+    }
+
+    std::vector<std::vector<hash_t> > Permutation::choose(
+            const std::vector<hash_t>& population, size_t r)
+    {
+        std::vector<std::vector<hash_t> > results;
+        for (Combinations combination(population.size(), r); !combination.done(); combination.next())
+        {
+            std::vector<hash_t> result(r);
+            for (size_t i = 0; i < r; ++i)
             {
-                result[j] = population[indices[j]];
+                result[i] = population[combination.indices()[i]];
             }
             results.push_back(result);
         }
+        return results;
     }
 
-    std::vector<Permutation> Permutation::create(size_t number_of_blocks,
-                                                 size_t different_bits)
+    size_t Permutation::count(size_t number_of_blocks, size_t different_bits)
     {
         if (number_of_blocks > Simhash::BITS)
         {
@@ -79,57 +227,93 @@ namespace Simhash {
             throw std::invalid_argument(message.str());
         }
 
+        return Combinations::count(number_of_blocks, number_of_blocks - different_bits);
+    }
+
+    std::vector<Permutation> Permutation::create(size_t number_of_blocks,
+                                                 size_t different_bits)
+    {
+        std::vector<Permutation> results;
+        results.reserve(count(number_of_blocks, different_bits));
+
+        /* The prefix of each permutation is a choice of blocks, in order. */
+        size_t prefix = number_of_blocks - different_bits;
+        for (Combinations combination(number_of_blocks, prefix); !combination.done(); combination.next())
+        {
+            results.push_back(from_combination(number_of_blocks, different_bits, combination));
+        }
+        return results;
+    }
+
+    Permutation Permutation::nth(size_t number_of_blocks, size_t different_bits, size_t i)
+    {
+        size_t prefix = number_of_blocks - different_bits;
+        if (i >= count(number_of_blocks, different_bits))
+        {
+            std::stringstream message;
+            message << "There are only " << count(number_of_blocks, different_bits)
+                    << " permutations";
+            throw std::invalid_argument(message.str());
+        }
+        return from_combination(number_of_blocks, different_bits,
+                                Combinations(number_of_blocks, prefix, i));
+    }
+
+    Permutation Permutation::from_combination(
+        size_t number_of_blocks, size_t different_bits, const Combinations& combination)
+    {
         /* These are the blocks, in mask form. */
-        std::vector<hash_t> blocks;
+        std::array<hash_t, BITS> blocks;
         for (size_t i = 0; i < number_of_blocks; ++i)
         {
-            hash_t mask(0);
             size_t start = (   i    * Simhash::BITS) / number_of_blocks;
             size_t end   = ((i + 1) * Simhash::BITS) / number_of_blocks;
-            for (size_t j = start; j < end; ++j)
-            {
-                mask |= (static_cast<hash_t>(1) << j);
-            }
-            blocks.push_back(mask);
+            hash_t ones = end - start == BITS ? ~static_cast<hash_t>(0) :
+                ((static_cast<hash_t>(1) << (end - start)) - 1);
+            blocks[i] = ones << start;
         }
 
-        /* This is the number of blocks in the leading prefix. */
-        size_t count = static_cast<size_t>(number_of_blocks - different_bits);
-
-        /* All the mask choices. */
-        std::vector<Permutation> results;
-        for (std::vector<hash_t>& choice : choose(blocks, count))
+        // The chosen blocks, and then the remaining ones -- those that were not chosen
+        std::array<hash_t, BITS> masks;
+        hash_t chosen(0);
+        size_t count(0);
+        for (size_t i = 0; i < combination.size(); ++i)
         {
-            // Add the remaining masks -- those that were not part of choice
-            for (hash_t block : blocks)
+            masks[count++] = blocks[combination.indices()[i]];
+            chosen |= static_cast<hash_t>(1) << combination.indices()[i];
+        }
+        for (size_t i = 0; i < number_of_blocks; ++i)
+        {
+            if (!(chosen & (static_cast<hash_t>(1) << i)))
             {
-                if (find(choice.begin(), choice.end(), block) == choice.end())
-                {
-                    choice.push_back(block);
-                }
+                masks[count++] = blocks[i];
             }
-
-            results.push_back(Permutation(different_bits, choice));
         }
-        
-        return results;
+        return Permutation(different_bits, masks.data(), count);
     }
-    
-    Permutation::Permutation(size_t different_bits, std::vector<hash_t>& masks)
-        : forward_masks(masks)
-        , reverse_masks()
-        , offsets()
+
+    Permutation::Permutation(size_t different_bits, const std::vector<hash_t>& masks)
+        : Permutation(different_bits, masks.data(), masks.size())
+    {}
+
+    Permutation::Permutation(size_t different_bits, const hash_t* masks, size_t count)
+        : blocks()
+        , prefix_blocks(count > different_bits ? count - different_bits : 0)
         , search_mask_(0)
+        , highest_prefix_mask(0)
     {
-        int j(0), i(0), width(0); // counters
+        if (count > Simhash::BITS)
+        {
+            std::stringstream message;
+            message << "Number of masks must not exceed " << Simhash::BITS;
+            throw std::invalid_argument(message.str());
+        }
+        const size_t number_of_blocks = count;
+        blocks.resize(number_of_blocks);
 
-        // All of these are O(forward_masks)
-        std::vector<size_t> widths;
-        widths.reserve(forward_masks.size());
-        reverse_masks.reserve(forward_masks.size());
-        offsets.reserve(forward_masks.size());
+        int j(0), i(0), width(0); // counters
 
-        std::vector<hash_t>::iterator mask_it(forward_masks.begin());
+        std::array<size_t, BITS> widths;
 
         /* To more easily and reasonably-efficiently calculate the permutations
          * of each of the hashes we insert, and since each block is just
@@ -137,9 +321,11 @@ namespace Simhash {
          * blocks, and the offset of their rightmost bit. With this, we'll
          * generate net offsets between their positions in the unpermuted and
          * permuted forms, and simultaneously generate reverse masks */
-        for(; mask_it != forward_masks.end(); ++mask_it)
+        for (size_t block = 0; block < number_of_blocks; ++block)
         {
-            hash_t mask = *mask_it;
+            hash_t mask = masks[block];
+            Block& move = blocks[block];
+            move.forward_mask = mask;
             /* Find where the 1's start, and where they end. After this, `i` is
              * the position to the right of the rightmost set bit. `j` is the
              * position of the leftmost set bit. In `width`, we keep a running
@@ -174,22 +360,16 @@ namespace Simhash {
              *       width += (j-i)          => 21
              *       offset = 62 - width - i => 21 */
             width += (j - i);
-            widths.push_back(j - i);
+            widths[block] = j - i;
 
             int offset = 64 - width - i;
-            offsets.push_back(offset);
+            move.left_shift  = static_cast<uint8_t>(offset > 0 ?  offset : 0);
+            move.right_shift = static_cast<uint8_t>(offset > 0 ?       0 : -offset);
 
             /* It's a trivial transformation, but we'll pre-compute our reverse
              * masks so that we don't have to compute for after the every time
              * we unpermute a number */
-            if (offset > 0)
-            {
-                reverse_masks.push_back(mask <<  offset);
-            }
-            else
-            {
-                reverse_masks.push_back(mask >> -offset);
-            }
+            move.reverse_mask = (mask << move.left_shift) >> move.right_shift;
         }
 
         /* Alright, we have to determine the low and high masks for this
@@ -198,55 +378,94 @@ namespace Simhash {
          *
          * After this, width should hold the number of bits that are in all but
          * the last d blocks */
-        std::vector<size_t>::iterator width_it(widths.begin());
-        for (width = 0; different_bits < widths.size(); ++different_bits, ++width_it)
+        for (width = 0; different_bits < number_of_blocks; ++different_bits)
         {
-            width += *width_it;
+            width += widths[number_of_blocks - different_bits - 1];
         }
 
         /* Set the first /width/ bits in the low mask to 1, and then shift it up
          * until it's a full 64-bit number. */
         for(i = 0    ; i < width; ++i) { search_mask_ = (search_mask_ << 1) | 1; }
         for(i = width; i < 64   ; ++i) { search_mask_ =  search_mask_ << 1;      }
+
+        /* Since blocks are contiguous and disjoint, comparing their masks
+         * compares their positions. */
+        for (size_t block = 0; block < prefix_blocks; ++block)
+        {
+            highest_prefix_mask = std::max(highest_prefix_mask, blocks[block].forward_mask);
+        }
     }
 
     hash_t Permutation::apply(hash_t hash) const
     {
-        std::vector<hash_t>::const_iterator masks_it(forward_masks.begin());
-        std::vector<int   >::const_iterator offset_it(     offsets.begin());
-
         hash_t result(0);
-        for (; masks_it != forward_masks.end(); ++masks_it, ++offset_it)
+        for (const Block& move : blocks)
         {
-            if (*offset_it > 0)
-            {
-                result = result | ((hash & *masks_it) <<   *offset_it );
-            }
-            else
-            {
-                result = result | ((hash & *masks_it) >> -(*offset_it));
-            }
+            result |= ((hash & move.forward_mask) << move.left_shift) >> move.right_shift;
         }
         return result;
     }
 
     hash_t Permutation::reverse(hash_t hash) const
     {
-        std::vector<hash_t>::const_iterator masks_it(reverse_masks.begin());
-        std::vector<int   >::const_iterator offset_it(     offsets.begin());
-
         hash_t result(0);
-        for (; masks_it != reverse_masks.end(); ++masks_it, ++offset_it)
+        for (const Block& move : blocks)
         {
-            if (*offset_it > 0)
-            {
-                result = result | ((hash & *masks_it) >>   *offset_it );
-            }
-            else
+            result |= ((hash & move.reverse_mask) >> move.left_shift) << move.right_shift;
+        }
+        return result;
+    }
+
+    void Permutation::apply_many(const hash_t* input, hash_t* output, size_t count) const
+    {
+        size_t done(0);
+        switch (isa())
+        {
+            case ISA_AVX512:
+                done = apply_avx512(blocks.data(), blocks.size(), input, output, count);
+                break;
+            case ISA_AVX2:
+                done = apply_avx2(blocks.data(), blocks.size(), input, output, count);
+                break;
+            default:
+                break;
+        }
+
+        // Whatever the vectorized kernels didn't handle
+        for (size_t i = done; i < count; ++i)
+        {
+            output[i] = apply(input[i]);
+        }
+    }
+
+    bool Permutation::owns(hash_t a, hash_t b) const
+    {
+        /* create() enumerates the prefixes in lexicographic order of their
+         * blocks' positions, so the first table in which a pair shares a prefix
+         * is the one whose prefix is the lowest blocks in which they agree. That
+         * is, they must agree in every block of this prefix, and disagree in
+         * every other block lower than the highest block of this prefix. */
+        hash_t differences = a ^ b;
+        for (size_t block = 0; block < blocks.size(); ++block)
+        {
+            hash_t mask = blocks[block].forward_mask;
+            bool agree = !(differences & mask);
+            if (block < prefix_blocks ? !agree : (agree && mask < highest_prefix_mask))
             {
-                result = result | ((hash & *masks_it) << -(*offset_it));
+                return false;
             }
         }
+        return true;
+    }
+
+    std::vector<hash_t> Permutation::masks() const
+    {
+        std::vector<hash_t> result;
+        result.reserve(blocks.size());
+        for (const Block& move : blocks)
+        {
+            result.push_back(move.forward_mask);
+        }
         return result;
     }
 
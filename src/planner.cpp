@@ -0,0 +1,154 @@
+#include "planner.h"
+#include "permutation.h"
+#include "sort.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+namespace Simhash {
+
+    namespace {
+
+        /* Rough costs, per table, of each hash and of each comparison, fit
+         * to find_all_sorted on a million uniform hashes. */
+        const double HASH_SECONDS = 45e-9;
+        const double COMPARISON_SECONDS = 0.5e-9;
+
+        /* The number of tables whose prefixes are counted in the sample. */
+        const size_t TABLE_SAMPLES = 32;
+
+        /* Plans with more tables than this are never chosen. */
+        const size_t MAX_TABLES = 1 << 20;
+
+        /**
+         * An evenly-spaced sample of `size` of the hashes, sorted and without
+         * duplicates, which find_all would discard.
+         */
+        std::vector<hash_t> take_sample(const hash_t* hashes, size_t count, size_t size)
+        {
+            size = std::min(size, count);
+            std::vector<hash_t> sample(size);
+            for (size_t i = 0; i < size; ++i)
+            {
+                sample[i] = hashes[static_cast<unsigned __int128>(i) * count / size];
+            }
+
+            std::vector<hash_t> scratch(size);
+            radix_sort(sample.data(), scratch.data(), size);
+            sample.erase(std::unique(sample.begin(), sample.end()), sample.end());
+            return sample;
+        }
+
+        /**
+         * The number of pairs of the sample that share a prefix under the
+         * permutation's search mask.
+         */
+        double count_pairs(const Permutation& permutation,
+                           const std::vector<hash_t>& sample,
+                           std::vector<hash_t>& copy,
+                           std::vector<hash_t>& scratch)
+        {
+            hash_t mask = permutation.search_mask();
+            copy.resize(sample.size());
+            scratch.resize(sample.size());
+            permutation.apply_many(sample.data(), copy.data(), sample.size());
+            radix_sort(copy.data(), scratch.data(), copy.size(), num_differing_bits(mask, 0));
+
+            double pairs(0);
+            for (size_t start = 0, end = 0; start < copy.size(); start = end)
+            {
+                for (; end < copy.size() && (copy[end] & mask) == (copy[start] & mask); ++end) { }
+                double size = end - start;
+                pairs += size * (size - 1) / 2;
+            }
+            return pairs;
+        }
+
+        Plan estimate(const std::vector<hash_t>& sample,
+                      size_t count,
+                      size_t number_of_blocks,
+                      size_t different_bits,
+                      std::vector<hash_t>& copy,
+                      std::vector<hash_t>& scratch)
+        {
+            size_t tables = Permutation::count(number_of_blocks, different_bits);
+            Plan plan = { number_of_blocks, different_bits, tables, 0, tables * count * sizeof(hash_t), 0 };
+
+            // Each pair of hashes is in the sample with the same probability
+            double n = count, s = sample.size();
+            double scale = s > 1 ? (n * (n - 1)) / (s * (s - 1)) : 0;
+
+            // A sample too small to have any pairs sharing a wide prefix
+            // would suggest none at all, so it's never taken to have fewer
+            // than if the hashes were uniform
+            size_t samples = std::min(TABLE_SAMPLES, tables);
+            double pairs(0);
+            for (size_t i = 0; i < samples; ++i)
+            {
+                Permutation permutation = Permutation::nth(
+                    number_of_blocks, different_bits, i * tables / samples);
+                size_t bits = num_differing_bits(permutation.search_mask(), 0);
+                double uniform = std::ldexp(n * (n - 1) / 2, -static_cast<int>(bits));
+                pairs += std::max(uniform, scale * count_pairs(permutation, sample, copy, scratch));
+            }
+
+            plan.comparisons = pairs * tables / samples;
+            plan.seconds = tables * n * HASH_SECONDS + plan.comparisons * COMPARISON_SECONDS;
+            return plan;
+        }
+    }
+
+    Plan estimate_plan(const hash_t* hashes,
+                       size_t count,
+                       size_t number_of_blocks,
+                       size_t different_bits,
+                       size_t sample_size)
+    {
+        std::vector<hash_t> copy, scratch;
+        return estimate(take_sample(hashes, count, sample_size), count,
+                        number_of_blocks, different_bits, copy, scratch);
+    }
+
+    Plan choose_plan(const hash_t* hashes,
+                     size_t count,
+                     size_t different_bits,
+                     size_t memory_budget,
+                     size_t sample_size)
+    {
+        std::vector<hash_t> sample(take_sample(hashes, count, sample_size));
+        std::vector<hash_t> copy, scratch;
+
+        // With a fixed distance, each additional block means more tables,
+        // each with a longer prefix. Every table's own cost and memory
+        // therefore only grow, and once they alone exceed the best plan so
+        // far (or the budget), no more blocks can do better.
+        Plan best = estimate(sample, count, different_bits + 1, different_bits, copy, scratch);
+        for (size_t blocks = different_bits + 2; blocks <= BITS; ++blocks)
+        {
+            double tables = Permutation::count(blocks, different_bits);
+            if (tables > MAX_TABLES || tables * count * HASH_SECONDS > best.seconds ||
+                (memory_budget && tables * count * sizeof(hash_t) > memory_budget))
+            {
+                break;
+            }
+
+            Plan plan = estimate(sample, count, blocks, different_bits, copy, scratch);
+            if (plan.seconds < best.seconds)
+            {
+                best = plan;
+            }
+        }
+        return best;
+    }
+
+    std::string describe_plan(const Plan& plan)
+    {
+        std::stringstream description;
+        description << plan.number_of_blocks << " blocks: " << plan.tables
+                    << " tables, about " << static_cast<size_t>(plan.comparisons)
+                    << " comparisons and " << plan.seconds << "s";
+        return description.str();
+    }
+}
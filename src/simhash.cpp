@@ -1,41 +1,417 @@
 #include "simhash.h"
+#include "cpu.h"
 #include "permutation.h"
+#include "parallel.h"
+#include "sort.h"
+#include "union_find.h"
 
 #include <algorithm>
-#include <list>
+#include <sstream>
+#include <stdexcept>
 
-size_t Simhash::num_differing_bits(Simhash::hash_t a, Simhash::hash_t b)
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+    /* Each of the find_within kernels considers candidates [start, count),
+     * appending the indices of those that match to indices[found...], and
+     * returns the new number found. The vectorized kernels leave whatever
+     * doesn't fill a whole vector to the scalar ones. */
+    size_t find_within_generic(Simhash::hash_t query,
+                               const Simhash::hash_t* candidates,
+                               size_t start,
+                               size_t count,
+                               size_t different_bits,
+                               size_t* indices,
+                               size_t found)
+    {
+        for (size_t i = start; i < count; ++i)
+        {
+            indices[found] = i;
+            found += (Simhash::popcount_generic(query ^ candidates[i]) <= different_bits);
+        }
+        return found;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __attribute__((target("popcnt")))
+    size_t find_within_popcnt(Simhash::hash_t query,
+                              const Simhash::hash_t* candidates,
+                              size_t start,
+                              size_t count,
+                              size_t different_bits,
+                              size_t* indices,
+                              size_t found)
+    {
+        for (size_t i = start; i < count; ++i)
+        {
+            indices[found] = i;
+            found += (Simhash::popcount_popcnt(query ^ candidates[i]) <= different_bits);
+        }
+        return found;
+    }
+
+    /* Without a vector popcount, count the bits in each 64-bit lane by
+     * looking up the count for each nibble and then summing the bytes. */
+    __attribute__((target("avx2,popcnt")))
+    size_t find_within_avx2(Simhash::hash_t query,
+                            const Simhash::hash_t* candidates,
+                            size_t start,
+                            size_t count,
+                            size_t different_bits,
+                            size_t* indices,
+                            size_t found)
+    {
+        const __m256i lookup = _mm256_setr_epi8(
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+        const __m256i queries = _mm256_set1_epi64x(static_cast<long long>(query));
+        const __m256i limit = _mm256_set1_epi64x(static_cast<long long>(different_bits));
+
+        size_t i = start;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m256i x = _mm256_xor_si256(queries, _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(candidates + i)));
+            __m256i low = _mm256_shuffle_epi8(lookup, _mm256_and_si256(x, nibble));
+            __m256i high = _mm256_shuffle_epi8(
+                lookup, _mm256_and_si256(_mm256_srli_epi64(x, 4), nibble));
+            __m256i bits = _mm256_sad_epu8(
+                _mm256_add_epi8(low, high), _mm256_setzero_si256());
+
+            int over = _mm256_movemask_pd(
+                _mm256_castsi256_pd(_mm256_cmpgt_epi64(bits, limit)));
+            for (int matches = ~over & 0xF; matches; matches &= matches - 1)
+            {
+                indices[found++] = i + __builtin_ctz(matches);
+            }
+        }
+        return find_within_popcnt(
+            query, candidates, i, count, different_bits, indices, found);
+    }
+
+    __attribute__((target("avx512f,avx512vpopcntdq,popcnt")))
+    size_t find_within_avx512(Simhash::hash_t query,
+                              const Simhash::hash_t* candidates,
+                              size_t start,
+                              size_t count,
+                              size_t different_bits,
+                              size_t* indices,
+                              size_t found)
+    {
+        const __m512i queries = _mm512_set1_epi64(static_cast<long long>(query));
+        const __m512i limit = _mm512_set1_epi64(static_cast<long long>(different_bits));
+
+        size_t i = start;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m512i x = _mm512_xor_si512(queries, _mm512_loadu_si512(candidates + i));
+            __mmask8 matches = _mm512_cmple_epu64_mask(_mm512_popcnt_epi64(x), limit);
+            for (unsigned int m = matches; m; m &= m - 1)
+            {
+                indices[found++] = i + __builtin_ctz(m);
+            }
+        }
+        return find_within_popcnt(
+            query, candidates, i, count, different_bits, indices, found);
+    }
+#endif
+}
+
+size_t Simhash::find_within(Simhash::hash_t query,
+                            const Simhash::hash_t* candidates,
+                            size_t count,
+                            size_t different_bits,
+                            size_t* indices)
 {
-    size_t count(0);
-    Simhash::hash_t n = a ^ b;
-    while (n)
+    switch (Simhash::isa())
     {
-        ++count;
-        n = n & (n - 1);
+#if defined(__x86_64__) || defined(__i386__)
+        case Simhash::ISA_AVX512:
+            return find_within_avx512(query, candidates, 0, count, different_bits, indices, 0);
+        case Simhash::ISA_AVX2:
+            return find_within_avx2(query, candidates, 0, count, different_bits, indices, 0);
+        case Simhash::ISA_POPCNT:
+            return find_within_popcnt(query, candidates, 0, count, different_bits, indices, 0);
+#endif
+        default:
+            return find_within_generic(query, candidates, 0, count, different_bits, indices, 0);
     }
-    return count;
+}
+
+namespace {
+
+    /* Each of the count_* kernels adds, for every bit position, the number of
+     * the hashes with that bit set to ones[bit]. The weigh_* kernels instead
+     * add the total weight of those hashes to sums[bit].
+     *
+     * The unweighted kernels keep a byte-wide counter for each bit, which is
+     * added to ones before it can overflow. */
+    const size_t FLUSH = 255;
+
+    void count_generic(const Simhash::hash_t* hashes, size_t count, uint64_t* ones)
+    {
+        const uint64_t lsbs = 0x0101010101010101ULL;
+        for (size_t start = 0; start < count; start += FLUSH)
+        {
+            // Byte k of counters[j] counts bit (8j + k)
+            uint64_t counters[8] = { 0 };
+            size_t end = std::min(count, start + FLUSH);
+            for (size_t i = start; i < end; ++i)
+            {
+                Simhash::hash_t hash = hashes[i];
+                for (size_t j = 0; j < 8; ++j)
+                {
+                    /* Copy the byte into every byte, keep bit k of byte k, and
+                     * then carry it up into bit 7 of that byte. */
+                    uint64_t spread = (((hash >> (8 * j)) & 0xFF) * lsbs) & 0x8040201008040201ULL;
+                    counters[j] += ((spread + 0x7F7F7F7F7F7F7F7FULL) >> 7) & lsbs;
+                }
+            }
+            for (size_t bit = 0; bit < Simhash::BITS; ++bit)
+            {
+                ones[bit] += (counters[bit / 8] >> (8 * (bit % 8))) & 0xFF;
+            }
+        }
+    }
+
+    void weigh_generic(const Simhash::hash_t* hashes,
+                       const int32_t* weights,
+                       size_t count,
+                       int64_t* sums)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            Simhash::hash_t hash = hashes[i];
+            int64_t weight = weights[i];
+            for (size_t bit = 0; bit < Simhash::BITS; ++bit)
+            {
+                sums[bit] += weight & -static_cast<int64_t>((hash >> bit) & 1);
+            }
+        }
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    /* Spread each byte of the hash across 8 bytes, and test a different bit in
+     * each of them; the comparison yields -1 for every set bit. */
+    __attribute__((target("avx2")))
+    void count_avx2(const Simhash::hash_t* hashes, size_t count, uint64_t* ones)
+    {
+        const __m256i low_bytes = _mm256_setr_epi8(
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+        const __m256i high_bytes = _mm256_add_epi8(low_bytes, _mm256_set1_epi8(4));
+        const __m256i bits = _mm256_set1_epi64x(0x8040201008040201LL);
+
+        for (size_t start = 0; start < count; start += FLUSH)
+        {
+            __m256i low = _mm256_setzero_si256();
+            __m256i high = _mm256_setzero_si256();
+            size_t end = std::min(count, start + FLUSH);
+            for (size_t i = start; i < end; ++i)
+            {
+                __m256i hash = _mm256_set1_epi64x(static_cast<long long>(hashes[i]));
+                low = _mm256_sub_epi8(low, _mm256_cmpeq_epi8(
+                    _mm256_and_si256(_mm256_shuffle_epi8(hash, low_bytes), bits), bits));
+                high = _mm256_sub_epi8(high, _mm256_cmpeq_epi8(
+                    _mm256_and_si256(_mm256_shuffle_epi8(hash, high_bytes), bits), bits));
+            }
+
+            uint8_t counters[Simhash::BITS];
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(counters), low);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(counters + 32), high);
+            for (size_t bit = 0; bit < Simhash::BITS; ++bit)
+            {
+                ones[bit] += counters[bit];
+            }
+        }
+    }
+
+    __attribute__((target("avx2")))
+    void weigh_avx2(const Simhash::hash_t* hashes,
+                    const int32_t* weights,
+                    size_t count,
+                    int64_t* sums)
+    {
+        // Lane k of accumulators[j] sums bit (4j + k)
+        __m256i accumulators[16];
+        for (__m256i& accumulator : accumulators)
+        {
+            accumulator = _mm256_setzero_si256();
+        }
+
+        const __m256i one = _mm256_set1_epi64x(1);
+        for (size_t i = 0; i < count; ++i)
+        {
+            __m256i hash = _mm256_set1_epi64x(static_cast<long long>(hashes[i]));
+            __m256i weight = _mm256_set1_epi64x(weights[i]);
+            __m256i shifts = _mm256_setr_epi64x(0, 1, 2, 3);
+            for (size_t j = 0; j < 16; ++j)
+            {
+                __m256i set = _mm256_and_si256(_mm256_srlv_epi64(hash, shifts), one);
+                accumulators[j] = _mm256_add_epi64(accumulators[j], _mm256_and_si256(
+                    _mm256_sub_epi64(_mm256_setzero_si256(), set), weight));
+                shifts = _mm256_add_epi64(shifts, _mm256_set1_epi64x(4));
+            }
+        }
+
+        for (size_t j = 0; j < 16; ++j)
+        {
+            int64_t lanes[4];
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), accumulators[j]);
+            for (size_t k = 0; k < 4; ++k)
+            {
+                sums[4 * j + k] += lanes[k];
+            }
+        }
+    }
+
+    /* With AVX-512BW, the hash itself is a mask selecting which byte counters
+     * to increment. */
+    __attribute__((target("avx512f,avx512bw")))
+    void count_avx512(const Simhash::hash_t* hashes, size_t count, uint64_t* ones)
+    {
+        const __m512i increment = _mm512_set1_epi8(1);
+        for (size_t start = 0; start < count; start += FLUSH)
+        {
+            __m512i counters = _mm512_setzero_si512();
+            size_t end = std::min(count, start + FLUSH);
+            for (size_t i = start; i < end; ++i)
+            {
+                counters = _mm512_mask_add_epi8(
+                    counters, static_cast<__mmask64>(hashes[i]), counters, increment);
+            }
+
+            uint8_t bytes[Simhash::BITS];
+            _mm512_storeu_si512(bytes, counters);
+            for (size_t bit = 0; bit < Simhash::BITS; ++bit)
+            {
+                ones[bit] += bytes[bit];
+            }
+        }
+    }
+
+    __attribute__((target("avx512f,avx512bw")))
+    void weigh_avx512(const Simhash::hash_t* hashes,
+                      const int32_t* weights,
+                      size_t count,
+                      int64_t* sums)
+    {
+        // Lane k of accumulators[j] sums bit (8j + k)
+        __m512i accumulators[8];
+        for (__m512i& accumulator : accumulators)
+        {
+            accumulator = _mm512_setzero_si512();
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            Simhash::hash_t hash = hashes[i];
+            __m512i weight = _mm512_set1_epi64(weights[i]);
+            for (size_t j = 0; j < 8; ++j)
+            {
+                accumulators[j] = _mm512_mask_add_epi64(
+                    accumulators[j], static_cast<__mmask8>(hash >> (8 * j)),
+                    accumulators[j], weight);
+            }
+        }
+
+        for (size_t j = 0; j < 8; ++j)
+        {
+            int64_t lanes[8];
+            _mm512_storeu_si512(lanes, accumulators[j]);
+            for (size_t k = 0; k < 8; ++k)
+            {
+                sums[8 * j + k] += lanes[k];
+            }
+        }
+    }
+#endif
 }
 
 Simhash::hash_t Simhash::compute(const std::vector<Simhash::hash_t>& hashes)
 {
-    // Initialize counts to 0
-    std::vector<long> counts(Simhash::BITS, 0);
+    return compute(hashes.data(), hashes.size());
+}
+
+Simhash::Accumulator::Accumulator() : ones_(), count_(0)
+{}
+
+void Simhash::Accumulator::add(const Simhash::hash_t* hashes, size_t count)
+{
+    // Count the number of 1's in each position of the hashes
+    switch (Simhash::isa())
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        case Simhash::ISA_AVX512:
+            count_avx512(hashes, count, ones_);
+            break;
+        case Simhash::ISA_AVX2:
+            count_avx2(hashes, count, ones_);
+            break;
+#endif
+        default:
+            count_generic(hashes, count, ones_);
+            break;
+    }
+    count_ += count;
+}
 
-    // Count the number of 1's, 0's in each position of the hashes
-    for (auto it = hashes.begin(); it != hashes.end(); ++it)
+Simhash::hash_t Simhash::Accumulator::result() const
+{
+    // A bit is set in the result if more of the hashes have it set than not
+    Simhash::hash_t result(0);
+    for (size_t i = 0; i < BITS; ++i)
     {
-        Simhash::hash_t hash = *it;
-        for (size_t i = 0; i < BITS; ++i)
+        if (2 * ones_[i] > count_)
         {
-            counts[i] += (hash & 1) ? 1 : -1;
-            hash >>= 1;
+            result |= (static_cast<Simhash::hash_t>(1) << i);
         }
     }
+    return result;
+}
 
-    // Produce the result
+Simhash::hash_t Simhash::compute(const Simhash::hash_t* hashes, size_t count)
+{
+    Simhash::Accumulator accumulator;
+    accumulator.add(hashes, count);
+    return accumulator.result();
+}
+
+Simhash::hash_t Simhash::compute(const Simhash::hash_t* hashes,
+                                 const int32_t* weights,
+                                 size_t count)
+{
+    // Sum the weights of the hashes with each bit set
+    int64_t sums[Simhash::BITS] = { 0 };
+    switch (Simhash::isa())
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        case Simhash::ISA_AVX512:
+            weigh_avx512(hashes, weights, count, sums);
+            break;
+        case Simhash::ISA_AVX2:
+            weigh_avx2(hashes, weights, count, sums);
+            break;
+#endif
+        default:
+            weigh_generic(hashes, weights, count, sums);
+            break;
+    }
+
+    // A bit is set in the result if it has more weight set than not
+    int64_t total(0);
+    for (size_t i = 0; i < count; ++i)
+    {
+        total += weights[i];
+    }
     Simhash::hash_t result(0);
-    for (size_t i = 0; i < BITS; ++i) {
-        if (counts[i] > 0)
+    for (size_t i = 0; i < BITS; ++i)
+    {
+        if (2 * sums[i] > total)
         {
             result |= (static_cast<Simhash::hash_t>(1) << i);
         }
@@ -43,59 +419,75 @@ Simhash::hash_t Simhash::compute(const std::vector<Simhash::hash_t>& hashes)
     return result;
 }
 
-/**
- * Find all near-matches in a set of hashes.
- *
- * This works by putting the provided hashes into a vector. Then, for each permutation,
- * apply the permutation and sort the permuted hashes. Then walk the hashes, finding each
- * unique prefix.
- *
- * For each unique prefix, consider all hashes sharing that prefix, adding matches with
- * the lower number first (to avoid duplication; suppose a < b -- we will only emit (a, b)
- * as a match, but (b, a) will not be emitted).
- */
-Simhash::matches_t Simhash::find_all(
-    std::unordered_set<Simhash::hash_t>& hashes,
-    size_t number_of_blocks,
-    size_t different_bits)
+void Simhash::compute_many(const Simhash::hash_t* hashes,
+                           const int32_t* weights,
+                           const size_t* offsets,
+                           size_t count,
+                           Simhash::hash_t* results,
+                           size_t threads)
 {
-    std::vector<Simhash::hash_t> copy(hashes.begin(), hashes.end());
-    Simhash::matches_t results;
-    auto permutations = Simhash::Permutation::create(number_of_blocks, different_bits);
-    for (Simhash::Permutation& permutation : permutations)
-    {
-        // Apply the permutation to the set of hashes and sort
-        auto op = [permutation](Simhash::hash_t h) -> Simhash::hash_t {
-            return permutation.apply(h);
-        };
-        std::transform(hashes.begin(), hashes.end(), copy.begin(), op);
-        std::sort(copy.begin(), copy.end());
+    // Documents tend to be small, so hand them out to threads in batches
+    const size_t batch = 1024;
+    size_t batches = (count + batch - 1) / batch;
+    Simhash::parallel_for(batches, threads, [&](size_t b, size_t) {
+        size_t end = std::min(count, (b + 1) * batch);
+        for (size_t i = b * batch; i < end; ++i)
+        {
+            size_t start = offsets[i];
+            size_t size = offsets[i + 1] - start;
+            results[i] = weights ? compute(hashes + start, weights + start, size)
+                                 : compute(hashes + start, size);
+        }
+    });
+}
 
-        // Walk through and find regions that have the same prefix subject to the mask
+namespace {
+
+    /**
+     * Apply the permutation to the `size` source hashes into copy, sort them on their
+     * prefix (using scratch and indices as buffers), and then call
+     * `emit(a, b)` with the original forms of every pair of hashes sharing a prefix
+     * under the permutation's search mask that are within `different_bits`.
+     */
+    template <typename Emit>
+    void scan_table(const Simhash::Permutation& permutation,
+                    const Simhash::hash_t* source,
+                    size_t size,
+                    std::vector<Simhash::hash_t>& copy,
+                    std::vector<Simhash::hash_t>& scratch,
+                    std::vector<size_t>& indices,
+                    size_t different_bits,
+                    Emit emit)
+    {
+        // Apply the permutation to the set of hashes and sort by the prefix alone
         Simhash::hash_t mask = permutation.search_mask();
-        auto start = copy.begin();
-        while (start != copy.end())
+        size_t prefix_bits = Simhash::num_differing_bits(mask, 0);
+        copy.resize(size);
+        scratch.resize(size);
+        permutation.apply_many(source, copy.data(), size);
+        Simhash::radix_sort(copy.data(), scratch.data(), copy.size(), prefix_bits);
+
+        // Walk through and find regions that have the same prefix subject to the mask
+        size_t start(0);
+        while (start != copy.size())
         {
             // Find the end of the range that starts with this prefix
-            Simhash::hash_t prefix = (*start) & mask;
-            std::vector<Simhash::hash_t>::iterator end = start;
-            for (; end != copy.end() && (*end & mask) == prefix; ++end) { }
-            
-            // For all the hashes that are between start and end, consider them all
-            for (auto a = start; a != end; ++a)
-            {
-                for (auto b = a + 1; b != end; ++b)
+            Simhash::hash_t prefix = copy[start] & mask;
+            size_t end = start;
+            for (; end != copy.size() && (copy[end] & mask) == prefix; ++end) { }
+
+            // For all the hashes that are between start and end, consider them all,
+            // comparing each against all of those after it at once
+            for (size_t a = start; end - a > 1; ++a)
+            {
+                size_t count = end - a - 1;
+                indices.resize(std::max(indices.size(), count));
+                size_t found = Simhash::find_within(
+                    copy[a], copy.data() + a + 1, count, different_bits, indices.data());
+                for (size_t i = 0; i < found; ++i)
                 {
-                    if (Simhash::num_differing_bits(*a, *b) <= different_bits)
-                    {
-                        Simhash::hash_t a_raw = permutation.reverse(*a);
-                        Simhash::hash_t b_raw = permutation.reverse(*b);
-                        // Insert the result keyed on the smaller of the two
-                        results.insert(
-                            std::make_pair(
-                                std::min(a_raw, b_raw),
-                                std::max(a_raw, b_raw)));
-                    }
+                    emit(permutation.reverse(copy[a]),
+                         permutation.reverse(copy[a + 1 + indices[i]]));
                 }
             }
 
@@ -103,62 +495,476 @@ Simhash::matches_t Simhash::find_all(
             start = end;
         }
     }
+}
+
+namespace {
+
+    /**
+     * Sort hashes and remove any duplicates.
+     */
+    void sort_unique(std::vector<Simhash::hash_t>& hashes)
+    {
+        std::vector<Simhash::hash_t> scratch(hashes.size());
+        Simhash::radix_sort(hashes.data(), scratch.data(), hashes.size());
+        hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+    }
+
+    /**
+     * Find all near-matches in a vector of distinct hashes.
+     *
+     * For each permutation, apply the permutation and sort the permuted hashes. Then
+     * walk the hashes, finding each unique prefix.
+     *
+     * For each unique prefix, consider all hashes sharing that prefix, adding matches
+     * with the lower number first (to avoid duplication; suppose a < b -- we will only
+     * emit (a, b) as a match, but (b, a) will not be emitted).
+     *
+     * Each permutation is independent of the others, so with more than one thread,
+     * each thread takes permutations as it becomes free (generating just that one),
+     * collecting matches into its own set. These are merged once all permutations
+     * have been processed.
+     */
+    Simhash::matches_t find_all_unique(
+        const Simhash::hash_t* source,
+        size_t size,
+        size_t number_of_blocks,
+        size_t different_bits,
+        size_t threads)
+    {
+        size_t tables = Simhash::Permutation::count(number_of_blocks, different_bits);
+
+        threads = Simhash::resolve_threads(threads);
+        std::vector<std::vector<Simhash::hash_t> > copies(threads);
+        std::vector<std::vector<Simhash::hash_t> > scratches(threads);
+        std::vector<std::vector<size_t> > indices(threads);
+        std::vector<Simhash::matches_t> results(threads);
+        Simhash::parallel_for(tables, threads, [&](size_t i, size_t worker) {
+            Simhash::matches_t& matches = results[worker];
+            auto emit = [&matches](Simhash::hash_t a, Simhash::hash_t b) {
+                // Insert the result keyed on the smaller of the two
+                matches.insert(std::make_pair(std::min(a, b), std::max(a, b)));
+            };
+            auto permutation = Simhash::Permutation::nth(number_of_blocks, different_bits, i);
+            scan_table(permutation, source, size, copies[worker], scratches[worker],
+                       indices[worker], different_bits, emit);
+        });
+
+        // Merge every thread's matches into the first
+        for (size_t worker = 1; worker < threads; ++worker)
+        {
+            results[0].insert(results[worker].begin(), results[worker].end());
+            Simhash::matches_t().swap(results[worker]);
+        }
+        return results[0];
+    }
+
+    /**
+     * Merge `count` sorted, unique matches into sorted, unique matches (of which they
+     * mustn't be part), and deduplicate. They're merged in from the back, so that
+     * nothing is overwritten before it's been read.
+     */
+    void merge_unique(Simhash::sorted_matches_t& matches,
+                      const Simhash::match_t* incoming,
+                      size_t count)
+    {
+        size_t i = matches.size(), j = count;
+        matches.resize(i + count);
+        for (size_t k = matches.size(); j > 0; )
+        {
+            matches[--k] = (i > 0 && incoming[j - 1] < matches[i - 1])
+                ? matches[--i] : incoming[--j];
+        }
+        matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+    }
+
+    /**
+     * Like find_all_unique, but each thread collects the matches from a table in a
+     * buffer, and then sorts just those and merges them with the (sorted,
+     * unique) matches it had so far. The same pair may be found in several tables, so
+     * deduplicating as we go keeps each buffer no larger than the number of distinct
+     * matches. The buffers are then combined in the same way.
+     *
+     * With more than one shard, only every `shards`th table is scanned, starting
+     * from table `shard`, and only the matches those tables own are kept.
+     */
+    Simhash::sorted_matches_t find_all_sorted_unique(
+        const Simhash::hash_t* source,
+        size_t size,
+        size_t number_of_blocks,
+        size_t different_bits,
+        size_t threads,
+        size_t shard = 0,
+        size_t shards = 1)
+    {
+        size_t tables = Simhash::Permutation::count(number_of_blocks, different_bits);
+        tables = tables > shard ? (tables - shard + shards - 1) / shards : 0;
+
+        threads = Simhash::resolve_threads(threads);
+        std::vector<std::vector<Simhash::hash_t> > copies(threads);
+        std::vector<std::vector<Simhash::hash_t> > scratches(threads);
+        std::vector<std::vector<size_t> > indices(threads);
+        std::vector<std::vector<Simhash::match_t> > found(threads);
+        std::vector<Simhash::sorted_matches_t> results(threads);
+        Simhash::parallel_for(tables, threads, [&](size_t i, size_t worker) {
+            std::vector<Simhash::match_t>& matches = found[worker];
+            matches.clear();
+            auto permutation = Simhash::Permutation::nth(
+                number_of_blocks, different_bits, shard + i * shards);
+            auto emit = [&matches, &permutation, shards](Simhash::hash_t a, Simhash::hash_t b) {
+                if (shards == 1 || permutation.owns(a, b))
+                {
+                    matches.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+                }
+            };
+            scan_table(permutation, source, size, copies[worker], scratches[worker],
+                       indices[worker], different_bits, emit);
 
-    return results;
+            // Within a single table, each pair is found at most once
+            std::sort(matches.begin(), matches.end());
+            merge_unique(results[worker], matches.data(), matches.size());
+        });
+
+        for (size_t worker = 1; worker < threads; ++worker)
+        {
+            merge_unique(results[0], results[worker].data(), results[worker].size());
+            Simhash::sorted_matches_t().swap(results[worker]);
+        }
+        return results[0];
+    }
 }
 
-// O(E)
-Simhash::clusters_t Simhash::find_clusters(
+Simhash::matches_t Simhash::find_all(
     std::unordered_set<Simhash::hash_t>& hashes,
     size_t number_of_blocks,
-    size_t different_bits)
+    size_t different_bits,
+    size_t threads)
 {
-    // Build up the edges of this graph
-    std::unordered_map<Simhash::hash_t, std::unordered_set<Simhash::hash_t> > nodes;
-    std::unordered_map<Simhash::hash_t, bool> visited;
-    for (const auto& match: find_all(hashes, number_of_blocks, different_bits))
+    std::vector<Simhash::hash_t> source(hashes.begin(), hashes.end());
+    return find_all_unique(
+        source.data(), source.size(), number_of_blocks, different_bits, threads);
+}
+
+Simhash::matches_t Simhash::find_all(
+    const Simhash::hash_t* hashes,
+    size_t count,
+    size_t number_of_blocks,
+    size_t different_bits,
+    size_t threads)
+{
+    std::vector<Simhash::hash_t> source(hashes, hashes + count);
+    sort_unique(source);
+    return find_all_unique(
+        source.data(), source.size(), number_of_blocks, different_bits, threads);
+}
+
+Simhash::sorted_matches_t Simhash::find_all_sorted(
+    std::unordered_set<Simhash::hash_t>& hashes,
+    size_t number_of_blocks,
+    size_t different_bits,
+    size_t threads)
+{
+    std::vector<Simhash::hash_t> source(hashes.begin(), hashes.end());
+    return find_all_sorted_unique(
+        source.data(), source.size(), number_of_blocks, different_bits, threads);
+}
+
+Simhash::sorted_matches_t Simhash::find_all_sorted(
+    const Simhash::hash_t* hashes,
+    size_t count,
+    size_t number_of_blocks,
+    size_t different_bits,
+    size_t threads)
+{
+    std::vector<Simhash::hash_t> source(hashes, hashes + count);
+    sort_unique(source);
+    return find_all_sorted_unique(
+        source.data(), source.size(), number_of_blocks, different_bits, threads);
+}
+
+Simhash::sorted_matches_t Simhash::find_all_sorted(
+    std::vector<Simhash::hash_t>& hashes,
+    size_t number_of_blocks,
+    size_t different_bits,
+    size_t threads)
+{
+    sort_unique(hashes);
+    return find_all_sorted_unique(
+        hashes.data(), hashes.size(), number_of_blocks, different_bits, threads);
+}
+
+Simhash::sorted_matches_t Simhash::find_all_sorted_shard(
+    const Simhash::hash_t* hashes,
+    size_t count,
+    size_t number_of_blocks,
+    size_t different_bits,
+    size_t shard,
+    size_t shards,
+    size_t threads)
+{
+    if (shard >= shards)
     {
-        nodes[match.first].insert(match.second);
-        nodes[match.second].insert(match.first);
-        visited[match.first] = false;
-        visited[match.second] = false;
+        std::stringstream message;
+        message << "Shard (" << shard << ") must be less than the number of shards ("
+                << shards << ")";
+        throw std::invalid_argument(message.str());
     }
 
-    // Go through every node that is connected to an edge, and conduct a BFS from it
-    // to build a cluster. Skip nodes that have already been visited.
-    Simhash::clusters_t clusters;
-    for (const auto& node : nodes)
+    std::vector<Simhash::hash_t> source(hashes, hashes + count);
+    sort_unique(source);
+    return find_all_sorted_unique(source.data(), source.size(), number_of_blocks,
+                                  different_bits, threads, shard, shards);
+}
+
+namespace {
+
+    /**
+     * The hashes sharing a prefix, threaded into lists by the set each belongs
+     * to, kept by each thread between tables to avoid reallocating them.
+     */
+    struct SetLists
     {
-        // If a node has already been visited, it's already in a cluster.
-        if (visited[node.first])
+        struct List
         {
-            continue;
+            size_t head;
+            size_t tail;
+        };
+
+        /* The index in the source of each hash, and the next in its list. */
+        std::vector<size_t> indices;
+        std::vector<size_t> next;
+        std::vector<List> lists;
+    };
+
+    /**
+     * Apply the permutation to the `size` source hashes into copy, sort them on their
+     * prefix, and merge the sets of every pair sharing a prefix that are within
+     * `different_bits`, where each hash's set is identified by its index in the
+     * source.
+     *
+     * Only connectivity matters, so rather than comparing every pair sharing a
+     * prefix, as scan_table does, they're kept in lists of those known to be in
+     * the same set. Each hash is compared with the members of each list only
+     * until it matches one of them, and not at all with those already in its
+     * own set (by way of other tables). Every list it matches is then joined
+     * into one. A prefix shared by many near-duplicates therefore costs about
+     * one comparison per hash, rather than one per pair.
+     *
+     * The body is inlined into a kernel for each way of counting bits, so that
+     * the count in its innermost loop is inlined too, and the instruction set
+     * is checked once per table rather than once per comparison.
+     */
+    template <size_t (*Popcount)(uint64_t)>
+    __attribute__((always_inline)) inline
+    void cluster_table_with(const Simhash::Permutation& permutation,
+                            const Simhash::hash_t* source,
+                            size_t size,
+                            std::vector<Simhash::hash_t>& copy,
+                            std::vector<Simhash::hash_t>& scratch,
+                            size_t different_bits,
+                            Simhash::UnionFind& sets,
+                            SetLists& lists)
+    {
+        const size_t none = static_cast<size_t>(-1);
+        Simhash::hash_t mask = permutation.search_mask();
+        copy.resize(size);
+        scratch.resize(size);
+        permutation.apply_many(source, copy.data(), size);
+        Simhash::radix_sort(
+            copy.data(), scratch.data(), copy.size(), Simhash::num_differing_bits(mask, 0));
+
+        size_t end(0);
+        for (size_t start = 0; start != copy.size(); start = end)
+        {
+            Simhash::hash_t prefix = copy[start] & mask;
+            for (end = start; end != copy.size() && (copy[end] & mask) == prefix; ++end) { }
+            if (end - start < 2)
+            {
+                continue;
+            }
+
+            lists.indices.resize(end - start);
+            lists.next.resize(end - start);
+            lists.lists.clear();
+            for (size_t a = 0; a < end - start; ++a)
+            {
+                lists.indices[a] = std::lower_bound(
+                    source, source + size, permutation.reverse(copy[start + a])) - source;
+                lists.next[a] = none;
+
+                // Find every list whose set this hash is, or is now, part of,
+                // joining each into the first
+                size_t joined = none;
+                for (size_t l = 0; l < lists.lists.size(); )
+                {
+                    SetLists::List& list = lists.lists[l];
+                    bool same = sets.same(lists.indices[a], lists.indices[list.head]);
+                    for (size_t b = list.head; !same && b != none; b = lists.next[b])
+                    {
+                        if (Popcount(copy[start + a] ^ copy[start + b]) <= different_bits)
+                        {
+                            sets.unite(lists.indices[a], lists.indices[b]);
+                            same = true;
+                        }
+                    }
+
+                    if (!same)
+                    {
+                        ++l;
+                    }
+                    else if (joined == none)
+                    {
+                        joined = l++;
+                    }
+                    else
+                    {
+                        lists.next[lists.lists[joined].tail] = list.head;
+                        lists.lists[joined].tail = list.tail;
+                        list = lists.lists.back();
+                        lists.lists.pop_back();
+                    }
+                }
+
+                if (joined == none)
+                {
+                    SetLists::List list = { a, a };
+                    lists.lists.push_back(list);
+                }
+                else
+                {
+                    lists.next[lists.lists[joined].tail] = a;
+                    lists.lists[joined].tail = a;
+                }
+            }
         }
+    }
 
-        // If a node has not been visited, then start a cluster emanating from it.
-        visited[node.first] = true;
-        Simhash::cluster_t cluster({node.first});
-        std::list<Simhash::hash_t> frontier(node.second.begin(), node.second.end());
-        while (!frontier.empty())
+    void cluster_table_generic(const Simhash::Permutation& permutation,
+                               const Simhash::hash_t* source,
+                               size_t size,
+                               std::vector<Simhash::hash_t>& copy,
+                               std::vector<Simhash::hash_t>& scratch,
+                               size_t different_bits,
+                               Simhash::UnionFind& sets,
+                               SetLists& lists)
+    {
+        cluster_table_with<Simhash::popcount_generic>(
+            permutation, source, size, copy, scratch, different_bits, sets, lists);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __attribute__((target("popcnt")))
+    void cluster_table_popcnt(const Simhash::Permutation& permutation,
+                              const Simhash::hash_t* source,
+                              size_t size,
+                              std::vector<Simhash::hash_t>& copy,
+                              std::vector<Simhash::hash_t>& scratch,
+                              size_t different_bits,
+                              Simhash::UnionFind& sets,
+                              SetLists& lists)
+    {
+        cluster_table_with<Simhash::popcount_popcnt>(
+            permutation, source, size, copy, scratch, different_bits, sets, lists);
+    }
+#endif
+
+    void cluster_table(const Simhash::Permutation& permutation,
+                       const Simhash::hash_t* source,
+                       size_t size,
+                       std::vector<Simhash::hash_t>& copy,
+                       std::vector<Simhash::hash_t>& scratch,
+                       size_t different_bits,
+                       Simhash::UnionFind& sets,
+                       SetLists& lists)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        if (Simhash::isa() >= Simhash::ISA_POPCNT)
         {
-            // The first frontier node is part of the cluster
-            Simhash::hash_t neighbor = frontier.front();
-            frontier.pop_front();
-            cluster.insert(neighbor);
-            visited[neighbor] = true;
+            cluster_table_popcnt(
+                permutation, source, size, copy, scratch, different_bits, sets, lists);
+            return;
+        }
+#endif
+        cluster_table_generic(
+            permutation, source, size, copy, scratch, different_bits, sets, lists);
+    }
+
+    /**
+     * Group the hashes in a vector of distinct, sorted hashes into clusters,
+     * leaving out any that have no matches at all.
+     *
+     * Each hash is identified by its position in the vector. Every match found while
+     * scanning the tables merges the sets containing the two hashes, so the clusters
+     * take shape as the tables are scanned, and only O(N) memory is needed no matter
+     * how many matches there are. Matches that would merge hashes already in the
+     * same set aren't looked for (see cluster_table). Threads scan tables
+     * concurrently, all sharing one lock-free union-find.
+     */
+    Simhash::clusters_t find_clusters_unique(
+        const Simhash::hash_t* source,
+        size_t size,
+        size_t number_of_blocks,
+        size_t different_bits,
+        size_t threads)
+    {
+        size_t tables = Simhash::Permutation::count(number_of_blocks, different_bits);
+
+        Simhash::UnionFind sets(size);
+        threads = Simhash::resolve_threads(threads);
+        std::vector<std::vector<Simhash::hash_t> > copies(threads);
+        std::vector<std::vector<Simhash::hash_t> > scratches(threads);
+        std::vector<SetLists> lists(threads);
+        Simhash::parallel_for(tables, threads, [&](size_t i, size_t worker) {
+            auto permutation = Simhash::Permutation::nth(number_of_blocks, different_bits, i);
+            cluster_table(permutation, source, size, copies[worker], scratches[worker],
+                          different_bits, sets, lists[worker]);
+        });
+        copies.clear();
+        scratches.clear();
+        lists.clear();
 
-            // Put every unvisited neighbor in the frontier
-            for (Simhash::hash_t hash : nodes[neighbor])
+        // Number the sets with more than one member, by their roots
+        const size_t none = static_cast<size_t>(-1);
+        std::vector<size_t> clusters_by_root(size, none);
+        Simhash::clusters_t clusters;
+        for (size_t i = 0; i < size; ++i)
+        {
+            // Each root is the smallest index in its set, so it's seen first
+            size_t root = sets.find(i);
+            if (root != i)
             {
-                if (!visited[hash])
+                if (clusters_by_root[root] == none)
                 {
-                    frontier.push_back(hash);
-                    visited[hash] = true;
+                    clusters_by_root[root] = clusters.size();
+                    clusters.push_back(Simhash::cluster_t({source[root]}));
                 }
+                clusters[clusters_by_root[root]].insert(source[i]);
             }
         }
-        clusters.push_back(cluster);
+        return clusters;
     }
+}
 
-    return clusters;
+Simhash::clusters_t Simhash::find_clusters(
+    std::unordered_set<Simhash::hash_t>& hashes,
+    size_t number_of_blocks,
+    size_t different_bits,
+    size_t threads)
+{
+    std::vector<Simhash::hash_t> source(hashes.begin(), hashes.end());
+    sort_unique(source);
+    return find_clusters_unique(
+        source.data(), source.size(), number_of_blocks, different_bits, threads);
+}
+
+Simhash::clusters_t Simhash::find_clusters(
+    const Simhash::hash_t* hashes,
+    size_t count,
+    size_t number_of_blocks,
+    size_t different_bits,
+    size_t threads)
+{
+    std::vector<Simhash::hash_t> source(hashes, hashes + count);
+    sort_unique(source);
+    return find_clusters_unique(
+        source.data(), source.size(), number_of_blocks, different_bits, threads);
 }
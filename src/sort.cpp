@@ -0,0 +1,147 @@
+#include "sort.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace Simhash {
+
+    namespace {
+
+        /* The number of bits sorted by each pass. */
+        const size_t RADIX_BITS = 8;
+        const size_t BUCKETS = static_cast<size_t>(1) << RADIX_BITS;
+
+        /* Below this many hashes, std::sort beats the overhead of histograms. */
+        const size_t THRESHOLD = 1024;
+
+        /* Above this many hashes, scattering across the whole range on every
+         * pass is dominated by cache and TLB misses. Instead, the hashes are
+         * first partitioned on their leading digit, and then each partition
+         * (which is then much more likely to fit in cache) is sorted on its
+         * own. */
+        const size_t PARTITION_THRESHOLD = 1 << 16;
+
+        /**
+         * Sort the range on the digits in bit positions [low, high) with an LSD
+         * radix sort. The sorted result is left in `hashes`.
+         */
+        void lsd_sort(hash_t* hashes, hash_t* scratch, size_t count, size_t low, size_t high)
+        {
+            if (count < THRESHOLD)
+            {
+                std::sort(hashes, hashes + count);
+                return;
+            }
+
+            // Compute the histograms for every pass in a single read
+            size_t passes = (high - low) / RADIX_BITS;
+            std::vector<size_t> counts(passes * BUCKETS, 0);
+            for (size_t i = 0; i < count; ++i)
+            {
+                for (size_t pass = 0; pass < passes; ++pass)
+                {
+                    size_t shift = low + pass * RADIX_BITS;
+                    ++counts[pass * BUCKETS + ((hashes[i] >> shift) & (BUCKETS - 1))];
+                }
+            }
+
+            hash_t* source = hashes;
+            hash_t* destination = scratch;
+            for (size_t pass = 0; pass < passes; ++pass)
+            {
+                size_t shift = low + pass * RADIX_BITS;
+                size_t* histogram = &counts[pass * BUCKETS];
+
+                // If every hash has the same digit, this pass wouldn't move anything
+                size_t first = (source[0] >> shift) & (BUCKETS - 1);
+                if (histogram[first] == count)
+                {
+                    continue;
+                }
+
+                // Turn counts into offsets, and then scatter
+                size_t offset(0);
+                for (size_t bucket = 0; bucket < BUCKETS; ++bucket)
+                {
+                    size_t size = histogram[bucket];
+                    histogram[bucket] = offset;
+                    offset += size;
+                }
+                for (size_t i = 0; i < count; ++i)
+                {
+                    destination[histogram[(source[i] >> shift) & (BUCKETS - 1)]++] = source[i];
+                }
+                std::swap(source, destination);
+            }
+
+            if (source != hashes)
+            {
+                std::copy(source, source + count, hashes);
+            }
+        }
+    }
+
+    void radix_sort(hash_t* hashes,
+                    hash_t* scratch,
+                    size_t count,
+                    size_t bits,
+                    size_t threads)
+    {
+        /* Sort whole digits, so round the number of bits up to a multiple of
+         * the digit size. */
+        bits = std::min(bits, BITS);
+        size_t low = BITS - ((bits + RADIX_BITS - 1) / RADIX_BITS) * RADIX_BITS;
+
+        if (count < PARTITION_THRESHOLD || low >= BITS - RADIX_BITS)
+        {
+            lsd_sort(hashes, scratch, count, low, BITS);
+            return;
+        }
+
+        /* Partition by the leading digit into scratch. Each thread counts a
+         * contiguous chunk of the input, and then scatters that same chunk to
+         * its own offsets within each bucket. */
+        threads = std::min(resolve_threads(threads), count / THRESHOLD);
+        size_t shift = BITS - RADIX_BITS;
+        size_t chunk = (count + threads - 1) / threads;
+        std::vector<size_t> counts(threads * BUCKETS, 0);
+        parallel_for(threads, threads, [&](size_t i, size_t worker) {
+            size_t* histogram = &counts[i * BUCKETS];
+            for (size_t j = i * chunk; j < std::min(count, (i + 1) * chunk); ++j)
+            {
+                ++histogram[hashes[j] >> shift];
+            }
+        });
+
+        std::vector<size_t> starts(BUCKETS + 1, 0);
+        size_t offset(0);
+        for (size_t bucket = 0; bucket < BUCKETS; ++bucket)
+        {
+            starts[bucket] = offset;
+            for (size_t i = 0; i < threads; ++i)
+            {
+                size_t size = counts[i * BUCKETS + bucket];
+                counts[i * BUCKETS + bucket] = offset;
+                offset += size;
+            }
+        }
+        starts[BUCKETS] = offset;
+
+        parallel_for(threads, threads, [&](size_t i, size_t worker) {
+            size_t* offsets = &counts[i * BUCKETS];
+            for (size_t j = i * chunk; j < std::min(count, (i + 1) * chunk); ++j)
+            {
+                scratch[offsets[hashes[j] >> shift]++] = hashes[j];
+            }
+        });
+
+        // Sort each bucket on the remaining digits, and move it back into place
+        parallel_for(BUCKETS, threads, [&](size_t bucket, size_t worker) {
+            size_t start = starts[bucket];
+            size_t size = starts[bucket + 1] - start;
+            lsd_sort(scratch + start, hashes + start, size, low, shift);
+            std::copy(scratch + start, scratch + start + size, hashes + start);
+        });
+    }
+}
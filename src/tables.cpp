@@ -0,0 +1,520 @@
+#include "tables.h"
+#include "parallel.h"
+#include "sort.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace Simhash {
+
+    namespace {
+
+        /**
+         * The first position in [begin, end) that is not less than `value`,
+         * searching outwards from `begin`, so that it's cheap to find positions
+         * that are close together.
+         */
+        const hash_t* gallop(const hash_t* begin, const hash_t* end, hash_t value)
+        {
+            size_t step(1);
+            while (step < static_cast<size_t>(end - begin) && begin[step - 1] < value)
+            {
+                begin += step;
+                step *= 2;
+            }
+            return std::lower_bound(begin, std::min(begin + step, end), value);
+        }
+
+        /**
+         * Call `visit(hash, distance)` with each hash in the table within
+         * `different_bits` of the query, unpermuted.
+         */
+        template <typename Visit>
+        void find_in_table(const Permutation& permutation,
+                           const Table& table,
+                           size_t different_bits,
+                           hash_t query,
+                           std::vector<hash_t>& decoded,
+                           std::vector<size_t>& indices,
+                           Visit visit)
+        {
+            /* All candidates share the query's prefix under the search mask,
+             * so they lie between the query with all the unmasked bits cleared
+             * and the query with all of them set. */
+            hash_t permuted = permutation.apply(query);
+            hash_t mask = permutation.search_mask();
+            hash_t low = permuted & mask;
+            hash_t high = permuted | ~mask;
+
+            std::pair<const hash_t*, size_t> range = table.range(low, high, decoded);
+            const hash_t* candidates = range.first;
+            size_t count = range.second;
+
+            // Permutations preserve the number of differing bits
+            indices.resize(std::max(indices.size(), count));
+            size_t found = find_within(permuted, candidates, count, different_bits, indices.data());
+            for (size_t j = 0; j < found; ++j)
+            {
+                hash_t candidate = candidates[indices[j]];
+                visit(permutation.reverse(candidate), num_differing_bits(permuted, candidate));
+            }
+        }
+
+        /**
+         * Prefetch where the hashes of the table with the prefix lie. With a
+         * directory, that's the directory entry when `directory` is set, and
+         * otherwise the start of the range it gives. Without one, it's where
+         * the prefix would be if the hashes were uniformly distributed.
+         */
+        void prefetch(const Table& table, hash_t prefix, bool directory)
+        {
+            if (table.compressed || table.size == 0)
+            {
+                return;
+            }
+
+            if (table.directory)
+            {
+                size_t bucket = table.directory_bits ? prefix >> (BITS - table.directory_bits) : 0;
+                if (directory)
+                {
+                    __builtin_prefetch(table.directory + bucket);
+                }
+                else
+                {
+                    __builtin_prefetch(table.data + table.directory[bucket]);
+                }
+            }
+            else if (!directory)
+            {
+                size_t estimate = (static_cast<unsigned __int128>(prefix) * table.size) >> BITS;
+                __builtin_prefetch(table.data + estimate);
+            }
+        }
+
+        /* How many queries ahead to prefetch the table, and its directory. */
+        const size_t PREFETCH_DISTANCE = 8;
+
+        /* The fewest queries for which a table is worth walking on its own,
+         * when a batch is split to share tables between more threads. */
+        const size_t MIN_BATCH_SLICE = 256;
+
+        /**
+         * Call `visit(start, stop, first, last)` for each run of queries
+         * [start, stop) that share a prefix under the mask, with the hashes of
+         * the table sharing it in [first, last). The queries must be sorted on
+         * that prefix.
+         *
+         * Plain tables are searched onwards from where the last prefix was
+         * found (or from where the directory says its bucket starts, if that's
+         * further), so that they're read in order, while compressed tables skip
+         * straight to each prefix. The hashes of upcoming prefixes are
+         * prefetched, so that the misses on them overlap with the work on the
+         * current one.
+         */
+        template <typename Visit>
+        void walk_table(const Table& table,
+                        const std::vector<hash_t>& queries,
+                        hash_t mask,
+                        std::vector<hash_t>& decoded,
+                        Visit visit)
+        {
+            const hash_t* cursor = table.data;
+            const hash_t* end = table.data + table.size;
+            size_t start(0);
+            while (start != queries.size())
+            {
+                // The queries sharing this prefix, and then the stored hashes that do
+                hash_t prefix = queries[start] & mask;
+                size_t stop = start;
+                for (; stop != queries.size() && (queries[stop] & mask) == prefix; ++stop) { }
+
+                if (stop + 2 * PREFETCH_DISTANCE < queries.size())
+                {
+                    prefetch(table, queries[stop + 2 * PREFETCH_DISTANCE] & mask, true);
+                }
+                if (stop + PREFETCH_DISTANCE < queries.size())
+                {
+                    prefetch(table, queries[stop + PREFETCH_DISTANCE] & mask, false);
+                }
+
+                if (table.compressed)
+                {
+                    std::pair<const hash_t*, size_t> range =
+                        table.range(prefix, prefix | ~mask, decoded);
+                    visit(start, stop, range.first, range.first + range.second);
+                }
+                else
+                {
+                    if (table.directory)
+                    {
+                        size_t bucket = table.directory_bits ? prefix >> (BITS - table.directory_bits) : 0;
+                        cursor = std::max(cursor, table.data + table.directory[bucket]);
+                    }
+                    const hash_t* first = cursor = gallop(cursor, end, prefix);
+                    const hash_t* last = gallop(cursor, end, prefix | ~mask);
+                    for (; last != end && *last == (prefix | ~mask); ++last) { }
+                    cursor = last;
+                    visit(start, stop, first, last);
+                }
+
+                start = stop;
+            }
+        }
+
+        /**
+         * Merge the sorted, unique pairs found by each worker into the first.
+         */
+        sorted_matches_t merge_workers(std::vector<sorted_matches_t>& results)
+        {
+            for (size_t worker = 1; worker < results.size(); ++worker)
+            {
+                size_t existing = results[0].size();
+                results[0].insert(results[0].end(), results[worker].begin(), results[worker].end());
+                sorted_matches_t().swap(results[worker]);
+                std::inplace_merge(results[0].begin(), results[0].begin() + existing, results[0].end());
+                results[0].erase(std::unique(results[0].begin(), results[0].end()), results[0].end());
+            }
+            return std::move(results[0]);
+        }
+    }
+
+    void build_directory(const hash_t* data, size_t size, size_t bits, uint64_t* directory)
+    {
+        // Count the hashes with each prefix, and then sum them into offsets
+        size_t buckets = directory_size(bits) - 1;
+        std::fill(directory, directory + buckets + 1, 0);
+        for (size_t i = 0; i < size; ++i)
+        {
+            ++directory[bits ? (data[i] >> (BITS - bits)) + 1 : 1];
+        }
+        for (size_t bucket = 1; bucket <= buckets; ++bucket)
+        {
+            directory[bucket] += directory[bucket - 1];
+        }
+    }
+
+    const hash_t* Table::lower_bound(hash_t value) const
+    {
+        if (directory)
+        {
+            // Everything in earlier buckets is less, and in later ones more
+            size_t bucket = directory_bits ? value >> (BITS - directory_bits) : 0;
+            return std::lower_bound(
+                data + directory[bucket], data + directory[bucket + 1], value);
+        }
+
+        if (!samples)
+        {
+            return std::lower_bound(data, data + size, value);
+        }
+
+        /* The first sample not less than the value bounds the range in which
+         * the result lies, and the one before it the start of that range. */
+        size_t count = (size + stride - 1) / stride;
+        size_t sample = std::lower_bound(samples, samples + count, value) - samples;
+        if (sample == 0)
+        {
+            return data;
+        }
+        return std::lower_bound(
+            data + (sample - 1) * stride, data + std::min(sample * stride, size), value);
+    }
+
+    const hash_t* Table::upper_bound(hash_t value) const
+    {
+        if (directory)
+        {
+            size_t bucket = directory_bits ? value >> (BITS - directory_bits) : 0;
+            return std::upper_bound(
+                data + directory[bucket], data + directory[bucket + 1], value);
+        }
+
+        if (!samples)
+        {
+            return std::upper_bound(data, data + size, value);
+        }
+
+        size_t count = (size + stride - 1) / stride;
+        size_t sample = std::upper_bound(samples, samples + count, value) - samples;
+        if (sample == 0)
+        {
+            return data;
+        }
+        return std::upper_bound(
+            data + (sample - 1) * stride, data + std::min(sample * stride, size), value);
+    }
+
+    std::pair<const hash_t*, size_t> Table::range(
+        hash_t low, hash_t high, std::vector<hash_t>& scratch) const
+    {
+        if (compressed)
+        {
+            scratch.clear();
+            compressed->decode_range(low, high, scratch);
+            return std::make_pair(scratch.data(), scratch.size());
+        }
+
+        const hash_t* begin = lower_bound(low);
+        return std::make_pair(begin, static_cast<size_t>(upper_bound(high) - begin));
+    }
+
+    std::vector<hash_t> find_in_tables(const std::vector<Permutation>& permutations,
+                                       const std::vector<Table>& tables,
+                                       size_t different_bits,
+                                       hash_t query)
+    {
+        std::vector<hash_t> results;
+        std::vector<hash_t> decoded;
+        std::vector<size_t> indices;
+        for (size_t i = 0; i < tables.size(); ++i)
+        {
+            find_in_table(permutations[i], tables[i], different_bits, query, decoded, indices,
+                          [&results](hash_t hash, size_t) { results.push_back(hash); });
+        }
+
+        // A match may be found in more than one table
+        std::sort(results.begin(), results.end());
+        results.erase(std::unique(results.begin(), results.end()), results.end());
+        return results;
+    }
+
+    std::vector<Neighbor> nearest_in_tables(const std::vector<Permutation>& permutations,
+                                            const std::vector<Table>& tables,
+                                            size_t number_of_blocks,
+                                            size_t different_bits,
+                                            hash_t query,
+                                            size_t k)
+    {
+        std::vector<Neighbor> heap;
+        if (k == 0)
+        {
+            return heap;
+        }
+        // There are never more neighbors than hashes, however large k is
+        heap.reserve(std::min(k, tables[0].size));
+
+        /* The tables are in the order create() makes them, whose prefixes
+         * are the combinations of blocks in lexicographic order, and each
+         * hash is owned by the first whose prefix it shares. For one within
+         * e bits, that's at worst the first made of blocks e onwards, which
+         * follows every combination starting with a lower block. Once that
+         * table has been searched, every hash within e bits has been seen. */
+        size_t prefix_blocks = number_of_blocks - different_bits;
+        size_t covered(0), searched(1);
+
+        std::vector<hash_t> decoded;
+        std::vector<size_t> indices;
+        for (size_t i = 0; i < tables.size(); ++i)
+        {
+            // Only the closest distance seen so far need be looked for
+            size_t bound = heap.size() < k ? different_bits : heap.front().distance;
+            const Permutation& permutation = permutations[i];
+            find_in_table(permutation, tables[i], bound, query, decoded, indices,
+                          [&](hash_t hash, size_t distance) {
+                // Each hash is considered only in the table that owns it
+                Neighbor neighbor = { hash, distance };
+                if (!permutation.owns(query, hash))
+                {
+                    return;
+                }
+                if (heap.size() < k)
+                {
+                    heap.push_back(neighbor);
+                    std::push_heap(heap.begin(), heap.end());
+                }
+                else if (neighbor < heap.front())
+                {
+                    std::pop_heap(heap.begin(), heap.end());
+                    heap.back() = neighbor;
+                    std::push_heap(heap.begin(), heap.end());
+                }
+            });
+
+            // Nothing unseen can be as close as the furthest of k neighbors
+            while (covered < different_bits &&
+                   searched + Combinations::count(number_of_blocks - covered - 1,
+                                                  prefix_blocks - 1) <= i + 1)
+            {
+                searched += Combinations::count(number_of_blocks - covered - 1, prefix_blocks - 1);
+                ++covered;
+            }
+            if (heap.size() == k && heap.front().distance <= covered)
+            {
+                break;
+            }
+        }
+
+        std::sort_heap(heap.begin(), heap.end());
+        return heap;
+    }
+
+    std::vector<size_t> histogram_in_tables(const std::vector<Permutation>& permutations,
+                                            const std::vector<Table>& tables,
+                                            size_t different_bits,
+                                            hash_t query)
+    {
+        std::vector<size_t> counts(different_bits + 1, 0);
+        std::vector<hash_t> decoded;
+        std::vector<size_t> indices;
+        for (size_t i = 0; i < tables.size(); ++i)
+        {
+            const Permutation& permutation = permutations[i];
+            find_in_table(permutation, tables[i], different_bits, query, decoded, indices,
+                          [&](hash_t hash, size_t distance) {
+                // Each hash is counted only by the table that owns it
+                counts[distance] += permutation.owns(query, hash);
+            });
+        }
+        return counts;
+    }
+
+    sorted_matches_t probe_tables(const std::vector<Permutation>& permutations,
+                                  const std::vector<Table>& tables,
+                                  size_t different_bits,
+                                  const hash_t* queries,
+                                  size_t count,
+                                  size_t threads)
+    {
+        threads = resolve_threads(threads);
+        std::vector<std::vector<hash_t> > copies(threads);
+        std::vector<std::vector<hash_t> > scratches(threads);
+        std::vector<std::vector<hash_t> > decoded(threads);
+        std::vector<std::vector<size_t> > indices(threads);
+        std::vector<sorted_matches_t> results(threads);
+        parallel_for(tables.size(), threads, [&](size_t i, size_t worker) {
+            const Permutation& permutation = permutations[i];
+            const Table& table = tables[i];
+            std::vector<hash_t>& copy = copies[worker];
+            std::vector<size_t>& found = indices[worker];
+            sorted_matches_t& matches = results[worker];
+            size_t existing = matches.size();
+
+            /* A pair may share a prefix in several tables, but only one of
+             * them owns it. A query that's also stored may still be found by
+             * both sides, which the final deduplication takes care of. */
+            auto emit = [&](hash_t a, hash_t b) {
+                a = permutation.reverse(a);
+                b = permutation.reverse(b);
+                if (a != b && permutation.owns(a, b))
+                {
+                    matches.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+                }
+            };
+
+            // Permute the queries and sort them on their prefix
+            hash_t mask = permutation.search_mask();
+            copy.resize(count);
+            scratches[worker].resize(count);
+            permutation.apply_many(queries, copy.data(), count);
+            radix_sort(copy.data(), scratches[worker].data(), count, num_differing_bits(mask, 0));
+
+            walk_table(table, copy, mask, decoded[worker], [&](
+                size_t start, size_t stop, const hash_t* first, const hash_t* last) {
+                size_t candidates = std::max(static_cast<size_t>(last - first), stop - start);
+                found.resize(std::max(found.size(), candidates));
+                for (size_t a = start; a != stop; ++a)
+                {
+                    size_t hits = find_within(
+                        copy[a], first, last - first, different_bits, found.data());
+                    for (size_t j = 0; j < hits; ++j)
+                    {
+                        emit(copy[a], first[found[j]]);
+                    }
+
+                    hits = find_within(
+                        copy[a], copy.data() + a + 1, stop - a - 1, different_bits, found.data());
+                    for (size_t j = 0; j < hits; ++j)
+                    {
+                        emit(copy[a], copy[a + 1 + found[j]]);
+                    }
+                }
+            });
+
+            // Queries that are repeated, or also stored, may be found more than once
+            std::sort(matches.begin() + existing, matches.end());
+            std::inplace_merge(matches.begin(), matches.begin() + existing, matches.end());
+            matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+        });
+
+        return merge_workers(results);
+    }
+
+    BatchResults find_batch_in_tables(const std::vector<Permutation>& permutations,
+                                      const std::vector<Table>& tables,
+                                      size_t different_bits,
+                                      const hash_t* queries,
+                                      size_t count,
+                                      ThreadPool& pool)
+    {
+        // With more workers than tables, each table's share of the batch is
+        // split into slices too, so that none are left idle
+        size_t threads = pool.size();
+        size_t slices = tables.empty() ? 1 : (threads + tables.size() - 1) / tables.size();
+        slices = std::max(std::min(slices, count / MIN_BATCH_SLICE), static_cast<size_t>(1));
+
+        std::vector<std::vector<hash_t> > copies(threads);
+        std::vector<std::vector<hash_t> > scratches(threads);
+        std::vector<std::vector<hash_t> > decoded(threads);
+        std::vector<std::vector<size_t> > indices(threads);
+        std::vector<sorted_matches_t> results(threads);
+        pool.parallel_for(tables.size() * slices, [&](size_t job, size_t worker) {
+            size_t i = job / slices;
+            size_t begin = count * (job % slices) / slices;
+            size_t size = count * (job % slices + 1) / slices - begin;
+            const Permutation& permutation = permutations[i];
+            std::vector<hash_t>& copy = copies[worker];
+            std::vector<size_t>& found = indices[worker];
+            sorted_matches_t& matches = results[worker];
+            size_t existing = matches.size();
+
+            // Sorting the queries on their prefix lets the table be read in order
+            hash_t mask = permutation.search_mask();
+            copy.resize(size);
+            scratches[worker].resize(size);
+            permutation.apply_many(queries + begin, copy.data(), size);
+            radix_sort(copy.data(), scratches[worker].data(), size, num_differing_bits(mask, 0));
+
+            walk_table(tables[i], copy, mask, decoded[worker], [&](
+                size_t start, size_t stop, const hash_t* first, const hash_t* last) {
+                if (first == last)
+                {
+                    return;
+                }
+                found.resize(std::max(found.size(), static_cast<size_t>(last - first)));
+                for (size_t a = start; a != stop; ++a)
+                {
+                    size_t hits = find_within(
+                        copy[a], first, last - first, different_bits, found.data());
+                    for (size_t j = 0; j < hits; ++j)
+                    {
+                        matches.push_back(std::make_pair(
+                            permutation.reverse(copy[a]), permutation.reverse(first[found[j]])));
+                    }
+                }
+            });
+
+            // A neighbor may be found in several tables, and a query repeated
+            std::sort(matches.begin() + existing, matches.end());
+            std::inplace_merge(matches.begin(), matches.begin() + existing, matches.end());
+            matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+        });
+        sorted_matches_t matches = merge_workers(results);
+
+        // Lay out each query's neighbors in turn, in the order of the queries
+        BatchResults batch;
+        batch.offsets.reserve(count + 1);
+        batch.offsets.push_back(0);
+        for (size_t i = 0; i < count; ++i)
+        {
+            sorted_matches_t::const_iterator first = std::lower_bound(
+                matches.begin(), matches.end(), std::make_pair(queries[i], static_cast<hash_t>(0)));
+            for (; first != matches.end() && first->first == queries[i]; ++first)
+            {
+                batch.neighbors.push_back(first->second);
+            }
+            batch.offsets.push_back(batch.neighbors.size());
+        }
+        return batch;
+    }
+}
@@ -0,0 +1,109 @@
+#include "tokenizer.h"
+#include "cpu.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace Simhash {
+
+    namespace {
+
+        /* Fold to lower case and check the range with a single comparison. */
+        bool alpha(char c)
+        {
+            return static_cast<unsigned char>((c | 0x20) - 'a') < 26;
+        }
+
+        uint64_t alpha_mask_generic(const char* data, size_t length)
+        {
+            uint64_t mask(0);
+            for (size_t i = 0; i < length; ++i)
+            {
+                mask |= static_cast<uint64_t>(alpha(data[i])) << i;
+            }
+            return mask;
+        }
+
+        /* Each of these finds the masks of as many whole blocks as there are,
+         * and returns how many that is. */
+        size_t alpha_masks_generic(const char* data, size_t length, uint64_t* masks)
+        {
+            size_t blocks = length / 64;
+            for (size_t block = 0; block < blocks; ++block)
+            {
+                masks[block] = alpha_mask_generic(data + block * 64, 64);
+            }
+            return blocks;
+        }
+
+#if defined(__x86_64__) || defined(__i386__)
+        __attribute__((target("avx2")))
+        size_t alpha_masks_avx2(const char* data, size_t length, uint64_t* masks)
+        {
+            const __m256i lower = _mm256_set1_epi8(0x20);
+            const __m256i a = _mm256_set1_epi8('a');
+            const __m256i z = _mm256_set1_epi8(25);
+
+            size_t blocks = length / 64;
+            for (size_t block = 0; block < blocks; ++block)
+            {
+                uint64_t halves[2];
+                for (size_t half = 0; half < 2; ++half)
+                {
+                    __m256i bytes = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(data + block * 64 + half * 32));
+                    __m256i offsets = _mm256_sub_epi8(_mm256_or_si256(bytes, lower), a);
+                    // An unsigned offset is at most 25 if it's unchanged by min(offset, 25)
+                    __m256i letters = _mm256_cmpeq_epi8(_mm256_min_epu8(offsets, z), offsets);
+                    halves[half] = static_cast<uint32_t>(_mm256_movemask_epi8(letters));
+                }
+                masks[block] = halves[0] | (halves[1] << 32);
+            }
+            return blocks;
+        }
+
+        __attribute__((target("avx512f,avx512bw")))
+        size_t alpha_masks_avx512(const char* data, size_t length, uint64_t* masks)
+        {
+            const __m512i lower = _mm512_set1_epi8(0x20);
+            const __m512i a = _mm512_set1_epi8('a');
+            const __m512i letters = _mm512_set1_epi8(26);
+
+            size_t blocks = length / 64;
+            for (size_t block = 0; block < blocks; ++block)
+            {
+                __m512i bytes = _mm512_loadu_si512(data + block * 64);
+                __m512i offsets = _mm512_sub_epi8(_mm512_or_si512(bytes, lower), a);
+                masks[block] = _mm512_cmplt_epu8_mask(offsets, letters);
+            }
+            return blocks;
+        }
+#endif
+    }
+
+    void alpha_masks(const char* data, size_t length, uint64_t* masks)
+    {
+        size_t blocks(0);
+        switch (isa())
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            case ISA_AVX512:
+                blocks = alpha_masks_avx512(data, length, masks);
+                break;
+            case ISA_AVX2:
+                blocks = alpha_masks_avx2(data, length, masks);
+                break;
+#endif
+            default:
+                blocks = alpha_masks_generic(data, length, masks);
+                break;
+        }
+
+        // The remainder is less than a whole block
+        if (blocks * 64 < length)
+        {
+            masks[blocks] = alpha_mask_generic(data + blocks * 64, length - blocks * 64);
+        }
+    }
+}
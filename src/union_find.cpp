@@ -0,0 +1,84 @@
+#include "union_find.h"
+
+#include <algorithm>
+
+namespace Simhash {
+
+    UnionFind::UnionFind(size_t size) : parents_(size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            parents_[i].store(i, std::memory_order_relaxed);
+        }
+    }
+
+    size_t UnionFind::find(size_t index)
+    {
+        size_t parent = parents_[index].load(std::memory_order_acquire);
+        while (parent != index)
+        {
+            /* Point this node at its grandparent. If another thread got there
+             * first the result is no worse, so a failed exchange is ignored. */
+            size_t grandparent = parents_[parent].load(std::memory_order_acquire);
+            if (grandparent != parent)
+            {
+                size_t expected = parent;
+                parents_[index].compare_exchange_weak(
+                    expected, grandparent, std::memory_order_acq_rel);
+            }
+            index = parent;
+            parent = grandparent;
+        }
+        return index;
+    }
+
+    bool UnionFind::unite(size_t a, size_t b)
+    {
+        while (true)
+        {
+            a = find(a);
+            b = find(b);
+            if (a == b)
+            {
+                return false;
+            }
+
+            /* Link the larger root beneath the smaller one. This only succeeds
+             * if it is still a root; otherwise, another thread has linked it
+             * in the meantime, and we try again from the new roots. */
+            if (a < b)
+            {
+                std::swap(a, b);
+            }
+            size_t expected = a;
+            if (parents_[a].compare_exchange_strong(expected, b, std::memory_order_acq_rel))
+            {
+                return true;
+            }
+        }
+    }
+
+    bool UnionFind::same(size_t a, size_t b)
+    {
+        while (true)
+        {
+            a = find(a);
+            b = find(b);
+            if (a == b)
+            {
+                return true;
+            }
+
+            // If a is still a root, they really were different sets at that point
+            if (parents_[a].load(std::memory_order_acquire) == a)
+            {
+                return false;
+            }
+        }
+    }
+
+    size_t UnionFind::size() const
+    {
+        return parents_.size();
+    }
+}
@@ -0,0 +1,32 @@
+#include <gtest/gtest.h>
+
+#include "cpu.h"
+
+TEST(CpuTest, Detect)
+{
+    EXPECT_LE(Simhash::isa(), Simhash::detect_isa());
+}
+
+TEST(CpuTest, Limit)
+{
+    Simhash::isa_t previous = Simhash::limit_isa(Simhash::ISA_SCALAR);
+    EXPECT_EQ(Simhash::ISA_SCALAR, Simhash::isa());
+    EXPECT_EQ(Simhash::ISA_SCALAR, Simhash::limit_isa(previous));
+    EXPECT_EQ(Simhash::detect_isa(), Simhash::isa());
+}
+
+TEST(CpuTest, Popcount)
+{
+    const uint64_t words[] = { 0, 1, 0x8000000000000011ULL, 0xDEADBEEFDEADBEEFULL, ~0ULL };
+    for (uint64_t word : words)
+    {
+        size_t expected = static_cast<size_t>(__builtin_popcountll(word));
+        EXPECT_EQ(expected, Simhash::popcount_generic(word));
+#if defined(__x86_64__) || defined(__i386__)
+        if (Simhash::detect_isa() >= Simhash::ISA_POPCNT)
+        {
+            EXPECT_EQ(expected, Simhash::popcount_popcnt(word));
+        }
+#endif
+    }
+}
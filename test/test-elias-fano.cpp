@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "elias_fano.h"
+
+namespace {
+
+    std::vector<Simhash::hash_t> sorted_hashes(size_t count, Simhash::hash_t mask)
+    {
+        std::mt19937_64 generator(count);
+        std::vector<Simhash::hash_t> hashes(count);
+        for (Simhash::hash_t& hash : hashes)
+        {
+            hash = generator() & mask;
+        }
+        std::sort(hashes.begin(), hashes.end());
+        return hashes;
+    }
+
+    std::vector<Simhash::hash_t> brute_force(
+        const std::vector<Simhash::hash_t>& hashes, Simhash::hash_t low, Simhash::hash_t high)
+    {
+        std::vector<Simhash::hash_t> results;
+        for (Simhash::hash_t hash : hashes)
+        {
+            if (hash >= low && hash <= high)
+            {
+                results.push_back(hash);
+            }
+        }
+        return results;
+    }
+}
+
+TEST(EliasFanoTest, RoundTrip)
+{
+    // Including sizes around word boundaries, and repeated and extreme values
+    for (size_t count : { 0, 1, 2, 3, 63, 64, 65, 1000, 100000 })
+    {
+        for (Simhash::hash_t mask : { ~0ULL, 0xFFULL, 0xFFFF000000000000ULL })
+        {
+            std::vector<Simhash::hash_t> hashes = sorted_hashes(count, mask);
+            if (count > 2)
+            {
+                hashes.front() = 0;
+                hashes.back() = ~0ULL;
+            }
+
+            std::vector<uint64_t> words = Simhash::EliasFano::encode(hashes.data(), count);
+            Simhash::EliasFano encoded(words.data(), words.size());
+            EXPECT_EQ(count, encoded.size());
+            EXPECT_EQ(words.size(), encoded.length());
+
+            std::vector<Simhash::hash_t> decoded(count);
+            encoded.decode(decoded.data());
+            EXPECT_EQ(hashes, decoded);
+
+            std::vector<Simhash::hash_t> everything;
+            encoded.decode_range(0, ~0ULL, everything);
+            EXPECT_EQ(hashes, everything);
+        }
+    }
+}
+
+TEST(EliasFanoTest, DecodeRange)
+{
+    std::vector<Simhash::hash_t> hashes = sorted_hashes(5000, ~0ULL);
+    std::vector<uint64_t> words = Simhash::EliasFano::encode(hashes.data(), hashes.size());
+    Simhash::EliasFano encoded(words.data(), words.size());
+
+    std::mt19937_64 generator(42);
+    for (size_t i = 0; i < 2000; ++i)
+    {
+        // Ranges around stored hashes, of widths from nothing to everything
+        Simhash::hash_t low = hashes[generator() % hashes.size()] - (generator() % 3);
+        Simhash::hash_t high = low + (generator() >> (generator() % 64));
+        high = high < low ? ~0ULL : high;
+
+        std::vector<Simhash::hash_t> results(1, 17);
+        encoded.decode_range(low, high, results);
+        std::vector<Simhash::hash_t> expected(1, 17);
+        std::vector<Simhash::hash_t> found = brute_force(hashes, low, high);
+        expected.insert(expected.end(), found.begin(), found.end());
+        EXPECT_EQ(expected, results);
+    }
+
+    std::vector<Simhash::hash_t> results;
+    encoded.decode_range(5, 4, results);
+    EXPECT_TRUE(results.empty());
+}
+
+TEST(EliasFanoTest, Compact)
+{
+    // Uniform hashes take about 64 - log2(n) + 2.5 bits each
+    std::vector<Simhash::hash_t> hashes = sorted_hashes(1 << 16, ~0ULL);
+    std::vector<uint64_t> words = Simhash::EliasFano::encode(hashes.data(), hashes.size());
+    EXPECT_LT(words.size() * 64, hashes.size() * (64 - 16 + 3));
+}
+
+TEST(EliasFanoTest, Invalid)
+{
+    std::vector<Simhash::hash_t> hashes = sorted_hashes(1000, ~0ULL);
+    std::vector<uint64_t> words = Simhash::EliasFano::encode(hashes.data(), hashes.size());
+
+    ASSERT_THROW(Simhash::EliasFano(words.data(), 3), std::invalid_argument);
+    ASSERT_THROW(Simhash::EliasFano(words.data(), words.size() - 1), std::invalid_argument);
+
+    std::vector<uint64_t> corrupt(words);
+    corrupt[1] += 1;
+    ASSERT_THROW(Simhash::EliasFano(corrupt.data(), corrupt.size()), std::invalid_argument);
+
+    corrupt = words;
+    corrupt[4 + 1] = ~0ULL;
+    ASSERT_THROW(Simhash::EliasFano(corrupt.data(), corrupt.size()), std::invalid_argument);
+}
@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+#include "external.h"
+
+namespace {
+
+    std::vector<Simhash::hash_t> clustered_hashes(size_t clusters, size_t size)
+    {
+        std::vector<Simhash::hash_t> hashes;
+        for (size_t i = 0; i < clusters; ++i)
+        {
+            Simhash::hash_t base =
+                (static_cast<Simhash::hash_t>(rand()) << 33) ^
+                (static_cast<Simhash::hash_t>(rand()) << 11) ^
+                 static_cast<Simhash::hash_t>(rand());
+            for (size_t j = 0; j < size; ++j)
+            {
+                Simhash::hash_t hash = base;
+                for (size_t k = 0; k < j % 4; ++k)
+                {
+                    hash ^= static_cast<Simhash::hash_t>(1) << (rand() % Simhash::BITS);
+                }
+                hashes.push_back(hash);
+            }
+        }
+        return hashes;
+    }
+}
+
+TEST(ExternalTest, MatchesFindAll)
+{
+    srand(7);
+    std::vector<Simhash::hash_t> hashes = clustered_hashes(5000, 6);
+
+    // Duplicates should be ignored
+    hashes.insert(hashes.end(), hashes.begin(), hashes.begin() + 100);
+
+    for (size_t budget : { 1 << 15, 1 << 16, 1 << 24 })
+    {
+        Simhash::sorted_matches_t actual;
+        size_t count = Simhash::find_all_external(
+            hashes.data(), hashes.size(), 6, 3, budget, "/tmp",
+            [&actual](const Simhash::match_t& match) { actual.push_back(match); });
+        EXPECT_EQ(actual.size(), count);
+
+        // Each match is emitted exactly once
+        std::sort(actual.begin(), actual.end());
+        EXPECT_EQ(actual.end(), std::unique(actual.begin(), actual.end()));
+        EXPECT_EQ(Simhash::find_all_sorted(hashes.data(), hashes.size(), 6, 3), actual);
+    }
+}
+
+TEST(ExternalTest, Empty)
+{
+    size_t count = Simhash::find_all_external(
+        nullptr, 0, 6, 3, 1 << 20, "/tmp", [](const Simhash::match_t& match) {});
+    EXPECT_EQ(0, count);
+}
+
+TEST(ExternalTest, BudgetTooSmall)
+{
+    std::vector<Simhash::hash_t> hashes = { 1, 2, 3 };
+    ASSERT_THROW(
+        Simhash::find_all_external(
+            hashes.data(), hashes.size(), 6, 3, 1024, "/tmp",
+            [](const Simhash::match_t& match) {}),
+        std::invalid_argument);
+}
+
+TEST(ExternalTest, MissingDirectory)
+{
+    std::vector<Simhash::hash_t> hashes = { 1, 2, 3 };
+    ASSERT_THROW(
+        Simhash::find_all_external(
+            hashes.data(), hashes.size(), 6, 3, 1 << 20, "/tmp/simhash-test-missing",
+            [](const Simhash::match_t& match) {}),
+        std::runtime_error);
+}
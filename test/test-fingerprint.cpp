@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+
+#include <cctype>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cpu.h"
+#include "fingerprint.h"
+
+namespace {
+
+    std::vector<std::string> tokenize(const std::string& text)
+    {
+        std::vector<std::string> tokens;
+        Simhash::AlphaTokenizer()(text.data(), text.size(), [&](const char* token, size_t size) {
+            tokens.push_back(std::string(token, size));
+        });
+        return tokens;
+    }
+
+    /**
+     * Fingerprint text the slow way, hashing the tokens of each window with
+     * the same cyclic polynomial, from scratch.
+     */
+    Simhash::hash_t reference(const std::string& text, size_t window)
+    {
+        Simhash::Jenkins jenkins;
+        std::vector<Simhash::hash_t> hashes;
+        for (const std::string& token : tokenize(text))
+        {
+            hashes.push_back(jenkins(token.data(), token.size()));
+        }
+
+        auto rotate = [](Simhash::hash_t hash, size_t bits) {
+            return bits ? (hash << bits) | (hash >> (Simhash::BITS - bits)) : hash;
+        };
+        std::vector<Simhash::hash_t> features;
+        for (size_t end = std::min(window, hashes.size()); end <= hashes.size() && end > 0; ++end)
+        {
+            Simhash::hash_t feature(0);
+            for (size_t i = end - std::min(window, end); i < end; ++i)
+            {
+                feature ^= rotate(hashes[i], end - 1 - i);
+            }
+            features.push_back(feature);
+        }
+        return Simhash::compute(features);
+    }
+}
+
+TEST(JenkinsTest, KnownValues)
+{
+    // From the driver in lookup3.c
+    EXPECT_EQ(0xDEADBEEFDEADBEEFULL, Simhash::Jenkins()("", 0));
+    std::string text("Four score and seven years ago");
+    EXPECT_EQ(0xCE7226E617770551ULL, Simhash::Jenkins()(text.data(), text.size()));
+    EXPECT_EQ(0xBD371DE4E3607CAEULL, Simhash::Jenkins(0, 1)(text.data(), text.size()));
+    EXPECT_EQ(0x6CBEA4B3CD628161ULL, Simhash::Jenkins(1, 0)(text.data(), text.size()));
+}
+
+TEST(JenkinsTest, EveryLength)
+{
+    // Hashing must only depend on the bytes in range
+    std::string text("the quick brown fox jumps over the lazy dog");
+    for (size_t length = 0; length < text.size(); ++length)
+    {
+        std::string copy(text, 0, length);
+        copy.reserve(64);
+        EXPECT_EQ(Simhash::Jenkins()(text.data(), length),
+                  Simhash::Jenkins()(copy.data(), copy.size()));
+    }
+}
+
+TEST(AlphaTokenizerTest, Basic)
+{
+    std::vector<std::string> expected = { "Hello", "world", "it", "s", "me" };
+    EXPECT_EQ(expected, tokenize("  Hello, world! it's 42 me\xC3\xA9"));
+    EXPECT_TRUE(tokenize("").empty());
+    EXPECT_TRUE(tokenize("123 [@`{]").empty());
+    EXPECT_EQ(std::vector<std::string>({ "AZaz" }), tokenize("AZaz"));
+}
+
+TEST(AlphaTokenizerTest, EveryInstructionSet)
+{
+    // Random bytes, with tokens crossing block and chunk boundaries
+    srand(42);
+    std::string text;
+    for (size_t i = 0; i < 3000; ++i)
+    {
+        text.push_back(rand() % 4 ? 'a' + rand() % 26 : static_cast<char>(rand()));
+    }
+    text.replace(1000, 100, std::string(100, 'x'));
+
+    std::vector<std::string> expected;
+    std::string token;
+    for (char c : text)
+    {
+        if (isalpha(static_cast<unsigned char>(c)) && static_cast<unsigned char>(c) < 128)
+        {
+            token.push_back(c);
+        }
+        else if (!token.empty())
+        {
+            expected.push_back(token);
+            token.clear();
+        }
+    }
+    if (!token.empty())
+    {
+        expected.push_back(token);
+    }
+
+    Simhash::isa_t previous = Simhash::limit_isa(Simhash::ISA_SCALAR);
+    for (int isa = Simhash::ISA_SCALAR; isa <= Simhash::ISA_AVX512; ++isa)
+    {
+        Simhash::limit_isa(static_cast<Simhash::isa_t>(isa));
+        EXPECT_EQ(expected, tokenize(text));
+    }
+    Simhash::limit_isa(previous);
+}
+
+TEST(FingerprinterTest, Empty)
+{
+    Simhash::Fingerprinter<> fingerprinter;
+    EXPECT_EQ(0, fingerprinter("", 0));
+    EXPECT_EQ(0, fingerprinter("1, 2, 3", 7));
+}
+
+TEST(FingerprinterTest, InvalidWindow)
+{
+    ASSERT_THROW(Simhash::Fingerprinter<>(0), std::invalid_argument);
+    ASSERT_THROW(Simhash::Fingerprinter<>(33), std::invalid_argument);
+}
+
+TEST(FingerprinterTest, MatchesReference)
+{
+    std::string text;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        text += "word" + std::string(1, 'a' + (i * 7) % 26) + std::string(1, 'a' + i % 13) + " ";
+    }
+
+    std::vector<size_t> lengths = { 0, 5, 20, 100, 4000, text.size() };
+    for (size_t window : { 1, 2, 4, 7, 32 })
+    {
+        Simhash::Fingerprinter<> fingerprinter(window);
+        for (size_t length : lengths)
+        {
+            EXPECT_EQ(reference(text.substr(0, length), window),
+                      fingerprinter(text.data(), length));
+        }
+    }
+}
+
+TEST(FingerprinterTest, NearDuplicates)
+{
+    std::string a("We the People of the United States, in Order to form a more perfect "
+                  "Union, establish Justice, insure domestic Tranquility, provide for the "
+                  "common defence, promote the general Welfare, and secure the Blessings "
+                  "of Liberty to ourselves and our Posterity, do ordain and establish this "
+                  "Constitution for the United States of America.");
+    std::string b(a);
+    b.replace(b.find("perfect"), 7, "imperfect");
+
+    Simhash::Fingerprinter<> fingerprinter;
+    size_t near = Simhash::num_differing_bits(
+        fingerprinter(a.data(), a.size()), fingerprinter(b.data(), b.size()));
+    size_t far = Simhash::num_differing_bits(
+        fingerprinter(a.data(), a.size()), fingerprinter(a.data(), 100));
+    EXPECT_LT(near, far);
+    EXPECT_LE(near, 10);
+}
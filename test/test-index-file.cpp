@@ -0,0 +1,227 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "index_file.h"
+
+namespace {
+
+    std::string temporary_path()
+    {
+        char path[] = "/tmp/simhash-test-index-file-XXXXXX";
+        int fd = mkstemp(path);
+        close(fd);
+        return path;
+    }
+
+    Simhash::hash_t random_hash()
+    {
+        return (static_cast<Simhash::hash_t>(rand()) << 33) ^
+               (static_cast<Simhash::hash_t>(rand()) << 11) ^
+                static_cast<Simhash::hash_t>(rand());
+    }
+
+    std::vector<Simhash::hash_t> near_duplicates(size_t count)
+    {
+        std::vector<Simhash::hash_t> hashes;
+        for (size_t i = 0; i < count; ++i)
+        {
+            Simhash::hash_t hash = i % 4 ? hashes.back() : random_hash();
+            hashes.push_back(hash ^ (static_cast<Simhash::hash_t>(1) << (rand() % 64)));
+        }
+        return hashes;
+    }
+}
+
+TEST(IndexFileTest, RoundTrip)
+{
+    srand(42);
+    std::vector<Simhash::hash_t> corpus = near_duplicates(2000);
+    std::vector<Simhash::hash_t> queries = near_duplicates(200);
+    for (size_t i = 0; i < 50; ++i)
+    {
+        queries.push_back(corpus[i * 17] ^ (static_cast<Simhash::hash_t>(3) << (i % 60)));
+    }
+
+    for (size_t directory_bits : { 0, 1, 10 })
+    {
+        Simhash::Index index(6, 3, directory_bits);
+        index.insert(corpus);
+        std::string path = temporary_path();
+        for (size_t stride : { 0, 1, 16, 5000 })
+        {
+            Simhash::write_index(index, path, stride);
+            Simhash::MappedIndex mapped(path);
+            EXPECT_EQ(index.size(), mapped.size());
+            EXPECT_EQ(directory_bits, mapped.directory_bits());
+            EXPECT_EQ(6, mapped.number_of_blocks());
+            EXPECT_EQ(3, mapped.different_bits());
+            ASSERT_EQ(index.permutations().size(), mapped.permutations().size());
+            for (size_t i = 0; i < index.permutations().size(); ++i)
+            {
+                EXPECT_EQ(index.permutations()[i].masks(), mapped.permutations()[i].masks());
+            }
+
+            EXPECT_TRUE(mapped.contains(corpus[10]));
+            for (Simhash::hash_t query : queries)
+            {
+                EXPECT_EQ(index.contains(query), mapped.contains(query));
+                EXPECT_EQ(index.find(query), mapped.find(query));
+                EXPECT_EQ(index.nearest(query, 3), mapped.nearest(query, 3));
+                EXPECT_EQ(index.histogram(query), mapped.histogram(query));
+            }
+            EXPECT_EQ(index.probe(queries.data(), queries.size()),
+                      mapped.probe(queries.data(), queries.size()));
+            EXPECT_EQ(index.find_batch(queries.data(), queries.size()).neighbors,
+                      mapped.find_batch(queries.data(), queries.size()).neighbors);
+        }
+        std::remove(path.c_str());
+    }
+}
+
+TEST(IndexFileTest, Compressed)
+{
+    srand(42);
+    std::vector<Simhash::hash_t> corpus = near_duplicates(2000);
+    std::vector<Simhash::hash_t> queries = near_duplicates(200);
+    queries.insert(queries.end(), corpus.begin(), corpus.begin() + 50);
+
+    Simhash::Index index(6, 3);
+    index.insert(corpus);
+    index.compress();
+    std::string path = temporary_path();
+    Simhash::write_index(index, path, 16);
+
+    Simhash::MappedIndex mapped(path);
+    EXPECT_TRUE(mapped.compressed());
+    EXPECT_EQ(index.size(), mapped.size());
+    EXPECT_EQ(0, mapped.directory_bits());
+    for (Simhash::hash_t query : queries)
+    {
+        EXPECT_EQ(index.contains(query), mapped.contains(query));
+        EXPECT_EQ(index.find(query), mapped.find(query));
+    }
+    EXPECT_EQ(index.probe(queries.data(), queries.size()),
+              mapped.probe(queries.data(), queries.size()));
+
+    // Truncating the last table
+    std::string contents;
+    {
+        std::ifstream stream(path, std::ifstream::binary);
+        contents.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    }
+    {
+        std::ofstream stream(path, std::ofstream::binary);
+        stream << contents.substr(0, contents.size() - 8);
+    }
+    ASSERT_THROW(Simhash::MappedIndex mapped(path), std::runtime_error);
+    std::remove(path.c_str());
+}
+
+TEST(IndexFileTest, Empty)
+{
+    Simhash::Index index(4, 3);
+    std::string path = temporary_path();
+    Simhash::write_index(index, path, 8);
+    Simhash::MappedIndex mapped(path);
+    EXPECT_EQ(0, mapped.size());
+    EXPECT_FALSE(mapped.contains(0xDEADBEEF));
+    EXPECT_TRUE(mapped.find(0xDEADBEEF).empty());
+    std::remove(path.c_str());
+}
+
+TEST(IndexFileTest, Invalid)
+{
+    ASSERT_THROW(Simhash::MappedIndex("/does/not/exist"), std::runtime_error);
+
+    // Not an index
+    std::string path = temporary_path();
+    {
+        std::ofstream stream(path, std::ofstream::binary);
+        stream << "not an index, but long enough to have a header";
+    }
+    ASSERT_THROW(Simhash::MappedIndex mapped(path), std::runtime_error);
+
+    Simhash::Index index(6, 3);
+    index.insert(near_duplicates(100));
+    Simhash::write_index(index, path);
+    std::string contents;
+    {
+        std::ifstream stream(path, std::ifstream::binary);
+        contents.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    }
+
+    // Truncated
+    {
+        std::ofstream stream(path, std::ofstream::binary);
+        stream << contents.substr(0, contents.size() - 8);
+    }
+    ASSERT_THROW(Simhash::MappedIndex mapped(path), std::runtime_error);
+
+    // From another version
+    contents[8] = Simhash::MappedIndex::VERSION + 1;
+    {
+        std::ofstream stream(path, std::ofstream::binary);
+        stream << contents;
+    }
+    ASSERT_THROW(Simhash::MappedIndex mapped(path), std::runtime_error);
+    contents[8] = 0;
+    {
+        std::ofstream stream(path, std::ofstream::binary);
+        stream << contents;
+    }
+    ASSERT_THROW(Simhash::MappedIndex mapped(path), std::runtime_error);
+    contents[8] = Simhash::MappedIndex::VERSION;
+
+    // With a mask of no bits at all, after the nine words of the header
+    {
+        std::ofstream stream(path, std::ofstream::binary);
+        stream << contents.substr(0, 9 * 8) << std::string(8, '\0') << contents.substr(10 * 8);
+    }
+    ASSERT_THROW(Simhash::MappedIndex mapped(path), std::runtime_error);
+
+    // With the first two tables' masks swapped, which are permutations but
+    // not in the order the searches expect
+    {
+        std::ofstream stream(path, std::ofstream::binary);
+        stream << contents.substr(0, 9 * 8) << contents.substr(15 * 8, 6 * 8)
+               << contents.substr(9 * 8, 6 * 8) << contents.substr(21 * 8);
+    }
+    ASSERT_THROW(Simhash::MappedIndex mapped(path), std::runtime_error);
+
+    // With a prefix directory that points past the end of its table
+    Simhash::Index directed(6, 3, 2);
+    directed.insert(near_duplicates(100));
+    Simhash::write_index(directed, path);
+    {
+        std::fstream stream(path, std::fstream::binary | std::fstream::in | std::fstream::out);
+        stream.seekp((9 + 6 * 20 + 1) * 8);
+        stream.put(static_cast<char>(200));
+    }
+    ASSERT_THROW(Simhash::MappedIndex mapped(path), std::runtime_error);
+
+    // With a prefix directory that doesn't start at the beginning
+    Simhash::write_index(directed, path);
+    {
+        std::fstream stream(path, std::fstream::binary | std::fstream::in | std::fstream::out);
+        stream.seekp((9 + 6 * 20) * 8);
+        stream.put(static_cast<char>(1));
+    }
+    ASSERT_THROW(Simhash::MappedIndex mapped(path), std::runtime_error);
+
+    // With a prefix directory that decreases
+    Simhash::write_index(directed, path);
+    {
+        std::fstream stream(path, std::fstream::binary | std::fstream::in | std::fstream::out);
+        stream.seekp((9 + 6 * 20 + 2) * 8);
+        stream.put(static_cast<char>(0));
+    }
+    ASSERT_THROW(Simhash::MappedIndex mapped(path), std::runtime_error);
+    std::remove(path.c_str());
+}
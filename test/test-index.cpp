@@ -0,0 +1,435 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "index.h"
+
+namespace {
+
+    /**
+     * Brute-force all the hashes within distance of the query, in order.
+     */
+    std::vector<Simhash::hash_t> brute_force(
+        const std::vector<Simhash::hash_t>& hashes,
+        Simhash::hash_t query,
+        size_t different_bits)
+    {
+        std::vector<Simhash::hash_t> results;
+        for (Simhash::hash_t hash : hashes)
+        {
+            if (Simhash::num_differing_bits(hash, query) <= different_bits)
+            {
+                results.push_back(hash);
+            }
+        }
+        std::sort(results.begin(), results.end());
+        results.erase(std::unique(results.begin(), results.end()), results.end());
+        return results;
+    }
+
+    /**
+     * Produce a hash with a few random bits of the provided one flipped.
+     */
+    Simhash::hash_t perturb(Simhash::hash_t hash, size_t bits)
+    {
+        for (size_t i = 0; i < bits; ++i)
+        {
+            hash ^= static_cast<Simhash::hash_t>(1) << (rand() % Simhash::BITS);
+        }
+        return hash;
+    }
+
+    Simhash::hash_t random_hash()
+    {
+        return (static_cast<Simhash::hash_t>(rand()) << 33) ^
+               (static_cast<Simhash::hash_t>(rand()) << 11) ^
+                static_cast<Simhash::hash_t>(rand());
+    }
+}
+
+TEST(IndexTest, Empty)
+{
+    Simhash::Index index(6, 3);
+    EXPECT_EQ(0, index.size());
+    EXPECT_EQ(3, index.different_bits());
+    EXPECT_EQ(20, index.permutations().size());
+    EXPECT_TRUE(index.find(0xDEADBEEF).empty());
+    EXPECT_FALSE(index.contains(0xDEADBEEF));
+}
+
+TEST(IndexTest, InvalidConfiguration)
+{
+    ASSERT_THROW(Simhash::Index(2, 3), std::invalid_argument);
+    ASSERT_THROW(Simhash::Index(6, 3, Simhash::MAX_DIRECTORY_BITS + 1), std::invalid_argument);
+}
+
+TEST(IndexTest, DirectoryBytes)
+{
+    EXPECT_EQ(0, Simhash::Index(6, 3).directory_bytes());
+    EXPECT_EQ(20 * 257 * 8, Simhash::Index(6, 3, 8).directory_bytes());
+}
+
+TEST(IndexTest, InsertRemove)
+{
+    Simhash::Index index(6, 3);
+    EXPECT_TRUE(index.insert(0xDEADBEEF));
+    EXPECT_FALSE(index.insert(0xDEADBEEF));
+    EXPECT_EQ(1, index.size());
+    EXPECT_TRUE(index.contains(0xDEADBEEF));
+
+    EXPECT_TRUE(index.remove(0xDEADBEEF));
+    EXPECT_FALSE(index.remove(0xDEADBEEF));
+    EXPECT_EQ(0, index.size());
+    EXPECT_FALSE(index.contains(0xDEADBEEF));
+}
+
+TEST(IndexTest, Find)
+{
+    Simhash::Index index(6, 3);
+    index.insert(0x000000FF);
+    index.insert(0x000000EF);
+    index.insert(0x000000CE);
+    index.insert(0x00000033);
+    index.insert(0xFF000000);
+
+    std::vector<Simhash::hash_t> expected = { 0x000000CE, 0x000000EF, 0x000000FF };
+    EXPECT_EQ(expected, index.find(0x000000EE));
+
+    index.remove(0x000000EF);
+    expected = { 0x000000CE, 0x000000FF };
+    EXPECT_EQ(expected, index.find(0x000000EE));
+}
+
+TEST(IndexTest, BulkInsert)
+{
+    Simhash::Index index(6, 3);
+    index.insert(0x000000FF);
+    index.insert(std::vector<Simhash::hash_t>({ 0x000000CE, 0x000000FF, 0x000000EF, 0x000000CE }));
+    EXPECT_EQ(3, index.size());
+
+    std::vector<Simhash::hash_t> expected = { 0x000000CE, 0x000000EF, 0x000000FF };
+    EXPECT_EQ(expected, index.find(0x000000EE));
+}
+
+TEST(IndexTest, FindMatchesBruteForce)
+{
+    srand(42);
+    for (size_t blocks = 4; blocks < 10; ++blocks)
+    {
+        std::vector<Simhash::hash_t> hashes;
+        for (size_t i = 0; i < 50; ++i)
+        {
+            Simhash::hash_t base = random_hash();
+            hashes.push_back(base);
+            for (size_t j = 0; j < 10; ++j)
+            {
+                hashes.push_back(perturb(base, rand() % 5));
+            }
+        }
+
+        Simhash::Index index(blocks, 3);
+        index.insert(hashes);
+
+        for (size_t i = 0; i < 100; ++i)
+        {
+            Simhash::hash_t query = perturb(hashes[rand() % hashes.size()], rand() % 5);
+            EXPECT_EQ(brute_force(hashes, query, 3), index.find(query));
+        }
+    }
+}
+
+TEST(IndexTest, DirectoryMatchesBruteForce)
+{
+    srand(42);
+    std::vector<Simhash::hash_t> hashes;
+    for (size_t i = 0; i < 50; ++i)
+    {
+        Simhash::hash_t base = random_hash();
+        hashes.push_back(base);
+        for (size_t j = 0; j < 10; ++j)
+        {
+            hashes.push_back(perturb(base, rand() % 5));
+        }
+    }
+
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+    std::random_shuffle(hashes.begin(), hashes.end());
+
+    for (size_t bits : { 1, 6, 16 })
+    {
+        // Directories must be kept up to date by single and bulk changes alike
+        Simhash::Index index(6, 3, bits);
+        index.insert(hashes.data(), hashes.size() / 2);
+        for (size_t i = hashes.size() / 2; i < hashes.size(); ++i)
+        {
+            index.insert(hashes[i]);
+        }
+        std::vector<Simhash::hash_t> remaining(hashes.begin() + 10, hashes.end());
+        for (size_t i = 0; i < 10; ++i)
+        {
+            index.remove(hashes[i]);
+        }
+
+        for (size_t i = 0; i < 100; ++i)
+        {
+            Simhash::hash_t query = perturb(hashes[rand() % hashes.size()], rand() % 5);
+            EXPECT_EQ(brute_force(remaining, query, 3), index.find(query));
+            EXPECT_EQ(!brute_force(remaining, query, 0).empty(), index.contains(query));
+        }
+    }
+}
+
+TEST(IndexTest, CompressedMatchesBruteForce)
+{
+    srand(42);
+    std::vector<Simhash::hash_t> hashes;
+    for (size_t i = 0; i < 100; ++i)
+    {
+        Simhash::hash_t base = random_hash();
+        hashes.push_back(base);
+        for (size_t j = 0; j < 10; ++j)
+        {
+            hashes.push_back(perturb(base, rand() % 5));
+        }
+    }
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+    std::random_shuffle(hashes.begin(), hashes.end());
+
+    Simhash::Index plain(6, 3);
+    plain.insert(hashes.data(), hashes.size() - 10);
+    Simhash::Index index(6, 3, 8);
+    index.insert(hashes.data(), hashes.size() - 10);
+    index.compress();
+    EXPECT_TRUE(index.compressed());
+    EXPECT_EQ(plain.size(), index.size());
+    EXPECT_EQ(0, index.directory_bytes());
+    EXPECT_LT(index.table_bytes(), plain.table_bytes());
+
+    // Changes are made to the decoded tables, which are encoded again
+    for (size_t i = hashes.size() - 10; i < hashes.size(); ++i)
+    {
+        EXPECT_TRUE(index.insert(hashes[i]));
+        plain.insert(hashes[i]);
+    }
+    EXPECT_TRUE(index.remove(hashes[0]));
+    EXPECT_FALSE(index.remove(hashes[0]));
+    plain.remove(hashes[0]);
+    index.insert(hashes.data() + 1, 5);
+    EXPECT_TRUE(index.compressed());
+    EXPECT_EQ(plain.size(), index.size());
+
+    std::vector<Simhash::hash_t> queries;
+    for (size_t i = 0; i < 200; ++i)
+    {
+        queries.push_back(perturb(hashes[rand() % hashes.size()], rand() % 5));
+    }
+    for (Simhash::hash_t query : queries)
+    {
+        EXPECT_EQ(plain.find(query), index.find(query));
+        EXPECT_EQ(plain.contains(query), index.contains(query));
+    }
+    EXPECT_FALSE(index.contains(hashes[0]));
+
+    // Copies have their own encodings
+    Simhash::Index copy(index);
+    copy = index;
+    index = Simhash::Index(6, 3);
+    EXPECT_EQ(plain.find(queries[0]), copy.find(queries[0]));
+    index = copy;
+    for (size_t threads : { 1, 3 })
+    {
+        EXPECT_EQ(plain.probe(queries.data(), queries.size(), threads),
+                  index.probe(queries.data(), queries.size(), threads));
+    }
+}
+
+TEST(IndexTest, ProbeMatchesBruteForce)
+{
+    srand(42);
+    std::vector<Simhash::hash_t> corpus, queries;
+    for (size_t i = 0; i < 100; ++i)
+    {
+        Simhash::hash_t base = random_hash();
+        corpus.push_back(base);
+        for (size_t j = 0; j < 5; ++j)
+        {
+            corpus.push_back(perturb(base, rand() % 5));
+            queries.push_back(perturb(base, rand() % 5));
+        }
+    }
+    // Some queries are repeated, or already in the corpus
+    queries.push_back(queries[0]);
+    queries.push_back(corpus[1]);
+
+    Simhash::sorted_matches_t expected;
+    for (size_t i = 0; i < queries.size(); ++i)
+    {
+        for (Simhash::hash_t other : corpus)
+        {
+            if (other != queries[i] && Simhash::num_differing_bits(other, queries[i]) <= 3)
+            {
+                expected.push_back(std::make_pair(
+                    std::min(other, queries[i]), std::max(other, queries[i])));
+            }
+        }
+        for (size_t j = 0; j < queries.size(); ++j)
+        {
+            if (queries[j] != queries[i] && Simhash::num_differing_bits(queries[j], queries[i]) <= 3)
+            {
+                expected.push_back(std::make_pair(
+                    std::min(queries[j], queries[i]), std::max(queries[j], queries[i])));
+            }
+        }
+    }
+    std::sort(expected.begin(), expected.end());
+    expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+
+    for (size_t blocks = 4; blocks < 10; ++blocks)
+    {
+        Simhash::Index index(blocks, 3);
+        index.insert(corpus.data(), corpus.size());
+        for (size_t threads : { 1, 3 })
+        {
+            EXPECT_EQ(expected, index.probe(queries.data(), queries.size(), threads));
+        }
+    }
+}
+
+TEST(IndexTest, ProbeEmpty)
+{
+    Simhash::Index index(6, 3);
+    Simhash::hash_t queries[] = { 0x000000FF, 0x000000EF };
+    Simhash::sorted_matches_t expected = { std::make_pair(0x000000EF, 0x000000FF) };
+    EXPECT_EQ(expected, index.probe(queries, 2));
+
+    index.insert(queries, 2);
+    EXPECT_TRUE(index.probe(queries, 0).empty());
+}
+
+TEST(IndexTest, FindBatchMatchesFind)
+{
+    srand(42);
+    std::vector<Simhash::hash_t> corpus, queries;
+    for (size_t i = 0; i < 100; ++i)
+    {
+        Simhash::hash_t base = random_hash();
+        corpus.push_back(base);
+        for (size_t j = 0; j < 5; ++j)
+        {
+            corpus.push_back(perturb(base, rand() % 5));
+            queries.push_back(perturb(base, rand() % 5));
+        }
+    }
+    // Some queries are repeated, stored, or have no neighbors
+    queries.push_back(queries[0]);
+    queries.push_back(corpus[1]);
+    queries.push_back(random_hash());
+
+    for (size_t variant = 0; variant < 3; ++variant)
+    {
+        Simhash::Index index(6, 3, variant == 1 ? 8 : 0);
+        index.insert(corpus);
+        if (variant == 2)
+        {
+            index.compress();
+        }
+
+        for (size_t threads : { 1, 3 })
+        {
+            Simhash::BatchResults results = index.find_batch(queries.data(), queries.size(), threads);
+            ASSERT_EQ(queries.size() + 1, results.offsets.size());
+            EXPECT_EQ(0, results.offsets[0]);
+            EXPECT_EQ(results.neighbors.size(), results.offsets.back());
+            for (size_t i = 0; i < queries.size(); ++i)
+            {
+                std::vector<Simhash::hash_t> neighbors(
+                    results.neighbors.begin() + results.offsets[i],
+                    results.neighbors.begin() + results.offsets[i + 1]);
+                EXPECT_EQ(index.find(queries[i]), neighbors);
+            }
+        }
+
+        // With more workers than tables, and enough queries, each table's
+        // share is split, and the same pool serves batch after batch
+        std::vector<Simhash::hash_t> doubled(queries);
+        doubled.insert(doubled.end(), queries.begin(), queries.end());
+        Simhash::ThreadPool pool(45);
+        for (size_t repeat = 0; repeat < 3; ++repeat)
+        {
+            Simhash::BatchResults results = index.find_batch(doubled.data(), doubled.size(), pool);
+            ASSERT_EQ(doubled.size() + 1, results.offsets.size());
+            for (size_t i = 0; i < doubled.size(); ++i)
+            {
+                std::vector<Simhash::hash_t> neighbors(
+                    results.neighbors.begin() + results.offsets[i],
+                    results.neighbors.begin() + results.offsets[i + 1]);
+                EXPECT_EQ(index.find(doubled[i]), neighbors);
+            }
+        }
+    }
+
+    Simhash::BatchResults empty = Simhash::Index(6, 3).find_batch(queries.data(), 0);
+    EXPECT_EQ(std::vector<size_t>(1, 0), empty.offsets);
+    EXPECT_TRUE(empty.neighbors.empty());
+}
+
+TEST(IndexTest, NearestMatchesBruteForce)
+{
+    srand(42);
+    std::vector<Simhash::hash_t> corpus, queries;
+    for (size_t i = 0; i < 100; ++i)
+    {
+        Simhash::hash_t base = random_hash();
+        corpus.push_back(base);
+        for (size_t j = 0; j < 8; ++j)
+        {
+            corpus.push_back(perturb(base, rand() % 5));
+        }
+        queries.push_back(perturb(base, rand() % 3));
+    }
+    queries.push_back(corpus[1]);
+    queries.push_back(random_hash());
+
+    for (size_t blocks : { 4, 6, 9 })
+    {
+        Simhash::Index index(blocks, 3);
+        index.insert(corpus);
+        for (Simhash::hash_t query : queries)
+        {
+            // Every neighbor within 3 bits, nearest first
+            std::vector<Simhash::Neighbor> expected;
+            std::vector<size_t> histogram(4, 0);
+            for (Simhash::hash_t hash : brute_force(corpus, query, 3))
+            {
+                size_t distance = Simhash::num_differing_bits(hash, query);
+                Simhash::Neighbor neighbor = { hash, distance };
+                expected.push_back(neighbor);
+                ++histogram[distance];
+            }
+            std::sort(expected.begin(), expected.end());
+            EXPECT_EQ(histogram, index.histogram(query));
+
+            for (size_t k : { 0, 1, 2, 5, 100 })
+            {
+                std::vector<Simhash::Neighbor> nearest(
+                    expected.begin(), expected.begin() + std::min(k, expected.size()));
+                EXPECT_EQ(nearest, index.nearest(query, k));
+            }
+        }
+    }
+}
+
+TEST(IndexTest, NearestLargeK)
+{
+    // k bounds the results, not the memory set aside for them
+    Simhash::Index index(6, 3);
+    index.insert({ 0x0, 0x1, 0x3 });
+    std::vector<Simhash::Neighbor> expected = { { 0x1, 0 }, { 0x0, 1 }, { 0x3, 1 } };
+    EXPECT_EQ(expected, index.nearest(0x1, 1ULL << 40));
+    EXPECT_EQ(expected, index.nearest(0x1, SIZE_MAX));
+}
@@ -0,0 +1,265 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "io.h"
+
+namespace {
+
+    /**
+     * Write contents to a temporary file, returning its path.
+     */
+    std::string temporary_file(const std::string& contents)
+    {
+        char path[] = "/tmp/simhash-test-io-XXXXXX";
+        int fd = mkstemp(path);
+        close(fd);
+        std::ofstream stream(path, std::ofstream::binary);
+        stream << contents;
+        return path;
+    }
+}
+
+TEST(IOTest, ParseFormat)
+{
+    EXPECT_EQ(Simhash::FORMAT_TEXT, Simhash::parse_format("text"));
+    EXPECT_EQ(Simhash::FORMAT_BINARY, Simhash::parse_format("binary"));
+    ASSERT_THROW(Simhash::parse_format("json"), std::invalid_argument);
+}
+
+TEST(IOTest, ParseHashes)
+{
+    std::string text = "0\n18446744073709551615\r\n\n  12345 678\n9";
+    std::vector<Simhash::hash_t> hashes;
+    Simhash::parse_hashes(text.data(), text.data() + text.size(), hashes);
+    std::vector<Simhash::hash_t> expected = {
+        0, 18446744073709551615ULL, 12345, 678, 9
+    };
+    EXPECT_EQ(expected, hashes);
+}
+
+TEST(IOTest, ParseHashesInvalid)
+{
+    std::vector<Simhash::hash_t> hashes;
+    std::string text = "123\nabc\n";
+    ASSERT_THROW(
+        Simhash::parse_hashes(text.data(), text.data() + text.size(), hashes),
+        std::invalid_argument);
+    text = "123x\n";
+    ASSERT_THROW(
+        Simhash::parse_hashes(text.data(), text.data() + text.size(), hashes),
+        std::invalid_argument);
+    text = "18446744073709551616\n";
+    ASSERT_THROW(
+        Simhash::parse_hashes(text.data(), text.data() + text.size(), hashes),
+        std::out_of_range);
+}
+
+TEST(IOTest, FormatHash)
+{
+    for (Simhash::hash_t hash : {
+            0ULL, 7ULL, 10ULL, 99ULL, 100ULL, 12345ULL, 18446744073709551615ULL })
+    {
+        char buffer[20];
+        char* end = Simhash::format_hash(hash, buffer);
+        EXPECT_EQ(std::to_string(hash), std::string(buffer, end));
+    }
+}
+
+TEST(IOTest, MappedFile)
+{
+    std::string path = temporary_file("hello");
+    {
+        Simhash::MappedFile file(path);
+        EXPECT_EQ("hello", std::string(file.data(), file.size()));
+    }
+    std::remove(path.c_str());
+
+    path = temporary_file("");
+    {
+        Simhash::MappedFile file(path);
+        EXPECT_EQ(0, file.size());
+    }
+    std::remove(path.c_str());
+
+    ASSERT_THROW(Simhash::MappedFile("/tmp/simhash-test-io-missing"), std::runtime_error);
+}
+
+TEST(IOTest, InputHashesText)
+{
+    std::string path = temporary_file("1\n2\n3\n");
+    Simhash::InputHashes hashes(path, Simhash::FORMAT_TEXT);
+    std::vector<Simhash::hash_t> expected = { 1, 2, 3 };
+    EXPECT_EQ(expected, std::vector<Simhash::hash_t>(hashes.data(), hashes.data() + hashes.size()));
+    std::remove(path.c_str());
+}
+
+TEST(IOTest, InputHashesBinary)
+{
+    std::string contents("\x01\x00\x00\x00\x00\x00\x00\x00\xEF\xBE\xAD\xDE\x00\x00\x00\x80", 16);
+    std::string path = temporary_file(contents);
+    Simhash::InputHashes hashes(path, Simhash::FORMAT_BINARY);
+    std::vector<Simhash::hash_t> expected = { 1, 0x80000000DEADBEEFULL };
+    EXPECT_EQ(expected, std::vector<Simhash::hash_t>(hashes.data(), hashes.data() + hashes.size()));
+    std::remove(path.c_str());
+
+    path = temporary_file(contents.substr(0, 12));
+    ASSERT_THROW(Simhash::InputHashes(path, Simhash::FORMAT_BINARY), std::runtime_error);
+    std::remove(path.c_str());
+}
+
+TEST(IOTest, InputHashesPipe)
+{
+    // A pipe has no size up front, so it must be read rather than mapped
+    char directory[] = "/tmp/simhash-test-io-XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(directory));
+    std::string path = std::string(directory) + "/pipe";
+    ASSERT_EQ(0, mkfifo(path.c_str(), 0600));
+    for (Simhash::format_t format : { Simhash::FORMAT_TEXT, Simhash::FORMAT_BINARY })
+    {
+        std::string contents = format == Simhash::FORMAT_TEXT
+            ? "1\n2\n3\n" : std::string("\x01\0\0\0\0\0\0\0\x02\0\0\0\0\0\0\0", 16);
+        std::thread writer([&path, &contents]() {
+            std::ofstream stream(path, std::ofstream::binary);
+            stream << contents;
+        });
+        Simhash::InputHashes hashes(path, format);
+        writer.join();
+        std::vector<Simhash::hash_t> expected = format == Simhash::FORMAT_TEXT
+            ? std::vector<Simhash::hash_t>({ 1, 2, 3 }) : std::vector<Simhash::hash_t>({ 1, 2 });
+        EXPECT_EQ(expected,
+                  std::vector<Simhash::hash_t>(hashes.data(), hashes.data() + hashes.size()));
+    }
+
+    // Nor can it be mapped directly
+    std::thread writer([&path]() {
+        std::ofstream stream(path, std::ofstream::binary);
+    });
+    ASSERT_THROW(Simhash::MappedFile file(path), std::runtime_error);
+    writer.join();
+    std::remove(path.c_str());
+    rmdir(directory);
+}
+
+TEST(IOTest, WriteMatches)
+{
+    Simhash::sorted_matches_t matches = { { 1, 2 }, { 3, 18446744073709551615ULL } };
+
+    std::stringstream text;
+    Simhash::write_matches(text, matches, Simhash::FORMAT_TEXT);
+    EXPECT_EQ("[1, 2]\n[3, 18446744073709551615]\n", text.str());
+
+    std::stringstream binary;
+    Simhash::write_matches(binary, matches, Simhash::FORMAT_BINARY);
+    std::string expected(
+        "\x01\x00\x00\x00\x00\x00\x00\x00\x02\x00\x00\x00\x00\x00\x00\x00"
+        "\x03\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF", 32);
+    EXPECT_EQ(expected, binary.str());
+}
+
+TEST(IOTest, WriteMatchesWithDistances)
+{
+    Simhash::sorted_matches_t matches = { { 1, 2 }, { 0, 18446744073709551615ULL } };
+
+    std::stringstream text;
+    Simhash::write_matches(text, matches, Simhash::FORMAT_TEXT, true);
+    EXPECT_EQ("[1, 2, 2]\n[0, 18446744073709551615, 64]\n", text.str());
+
+    std::stringstream binary;
+    Simhash::write_matches(binary, matches, Simhash::FORMAT_BINARY, true);
+    std::string expected(
+        "\x01\x00\x00\x00\x00\x00\x00\x00\x02\x00\x00\x00\x00\x00\x00\x00"
+        "\x02\x00\x00\x00\x00\x00\x00\x00"
+        "\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+        "\x40\x00\x00\x00\x00\x00\x00\x00", 48);
+    EXPECT_EQ(expected, binary.str());
+}
+
+TEST(IOTest, MergeMatches)
+{
+    auto binary = [](const Simhash::sorted_matches_t& matches, bool distances) {
+        std::stringstream stream;
+        Simhash::write_matches(stream, matches, Simhash::FORMAT_BINARY, distances);
+        return stream.str();
+    };
+
+    std::vector<std::string> paths = {
+        temporary_file(binary({ { 1, 2 }, { 1, 3 }, { 4, 5 } }, false)),
+        temporary_file(""),
+        temporary_file(binary({ { 0, 9 }, { 1, 3 }, { 6, 7 } }, false))
+    };
+    std::stringstream text;
+    EXPECT_EQ(5, Simhash::merge_matches(paths, text, Simhash::FORMAT_TEXT));
+    EXPECT_EQ("[0, 9]\n[1, 2]\n[1, 3]\n[4, 5]\n[6, 7]\n", text.str());
+    for (const std::string& path : paths)
+    {
+        std::remove(path.c_str());
+    }
+
+    paths = {
+        temporary_file(binary({ { 1, 2 }, { 4, 5 } }, true)),
+        temporary_file(binary({ { 1, 2 }, { 1, 3 } }, true))
+    };
+    std::stringstream merged;
+    EXPECT_EQ(3, Simhash::merge_matches(paths, merged, Simhash::FORMAT_BINARY, true));
+    EXPECT_EQ(binary({ { 1, 2 }, { 1, 3 }, { 4, 5 } }, true), merged.str());
+
+    for (const std::string& path : paths)
+    {
+        std::remove(path.c_str());
+    }
+
+    // Read without distances, a single match with one isn't whole
+    paths = { temporary_file(binary({ { 1, 2 } }, true)) };
+    ASSERT_THROW(Simhash::merge_matches(paths, merged, Simhash::FORMAT_BINARY),
+                 std::runtime_error);
+    std::remove(paths[0].c_str());
+}
+
+TEST(IOTest, MergeUnsortedMatches)
+{
+    std::stringstream stream;
+    Simhash::write_matches(
+        stream, { { 4, 5 }, { 1, 2 } }, Simhash::FORMAT_BINARY);
+    std::vector<std::string> paths = { temporary_file(stream.str()) };
+    std::stringstream merged;
+    ASSERT_THROW(Simhash::merge_matches(paths, merged, Simhash::FORMAT_TEXT),
+                 std::runtime_error);
+    std::remove(paths[0].c_str());
+
+    paths[0] = "/tmp/simhash-test-io-missing";
+    ASSERT_THROW(Simhash::merge_matches(paths, merged, Simhash::FORMAT_TEXT),
+                 std::runtime_error);
+}
+
+TEST(IOTest, WriteManyMatches)
+{
+    Simhash::sorted_matches_t matches(100000, std::make_pair(123456789, 987654321));
+    std::stringstream text;
+    Simhash::write_matches(text, matches, Simhash::FORMAT_TEXT);
+    EXPECT_EQ(100000 * std::string("[123456789, 987654321]\n").size(), text.str().size());
+}
+
+TEST(IOTest, WriteClusters)
+{
+    Simhash::clusters_t clusters = { { 5 } };
+
+    std::stringstream text;
+    Simhash::write_clusters(text, clusters, Simhash::FORMAT_TEXT);
+    EXPECT_EQ("[5]\n", text.str());
+
+    std::stringstream binary;
+    Simhash::write_clusters(binary, clusters, Simhash::FORMAT_BINARY);
+    std::string expected(
+        "\x01\x00\x00\x00\x00\x00\x00\x00\x05\x00\x00\x00\x00\x00\x00\x00", 16);
+    EXPECT_EQ(expected, binary.str());
+}
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "parallel.h"
+
+TEST(ParallelTest, ResolveThreads)
+{
+    EXPECT_EQ(3, Simhash::resolve_threads(3));
+    EXPECT_LE(1, Simhash::resolve_threads(0));
+}
+
+TEST(ParallelTest, VisitsEveryIndexOnce)
+{
+    for (size_t threads = 0; threads < 5; ++threads)
+    {
+        std::vector<std::atomic<int> > visits(100);
+        for (auto& count : visits)
+        {
+            count = 0;
+        }
+        Simhash::parallel_for(visits.size(), threads, [&](size_t i, size_t worker) {
+            EXPECT_LT(worker, Simhash::resolve_threads(threads));
+            ++visits[i];
+        });
+        for (const auto& count : visits)
+        {
+            EXPECT_EQ(1, count);
+        }
+    }
+}
+
+TEST(ParallelTest, Empty)
+{
+    size_t calls(0);
+    Simhash::parallel_for(0, 4, [&](size_t i, size_t worker) { ++calls; });
+    EXPECT_EQ(0, calls);
+}
+
+TEST(ParallelTest, RethrowsExceptions)
+{
+    for (size_t threads = 1; threads < 5; ++threads)
+    {
+        auto function = [](size_t i, size_t worker) {
+            if (i == 7)
+            {
+                throw std::runtime_error("Failed");
+            }
+        };
+        ASSERT_THROW(Simhash::parallel_for(20, threads, function), std::runtime_error);
+    }
+}
+
+TEST(ParallelTest, ThreadPool)
+{
+    Simhash::ThreadPool single(1);
+    EXPECT_EQ(1, single.size());
+    EXPECT_LE(1, Simhash::ThreadPool().size());
+
+    // The same workers serve call after call, each visiting every index once
+    Simhash::ThreadPool pool(4);
+    EXPECT_EQ(4, pool.size());
+    for (size_t call = 0; call < 50; ++call)
+    {
+        std::vector<std::atomic<int> > visits(call);
+        for (auto& count : visits)
+        {
+            count = 0;
+        }
+        pool.parallel_for(visits.size(), [&](size_t i, size_t worker) {
+            EXPECT_LT(worker, pool.size());
+            ++visits[i];
+        });
+        for (const auto& count : visits)
+        {
+            EXPECT_EQ(1, count);
+        }
+    }
+
+    // Exceptions are rethrown, and the pool is usable afterwards
+    auto function = [](size_t i, size_t worker) {
+        if (i == 7)
+        {
+            throw std::runtime_error("Failed");
+        }
+    };
+    ASSERT_THROW(pool.parallel_for(20, function), std::runtime_error);
+    std::atomic<size_t> calls(0);
+    pool.parallel_for(20, [&](size_t i, size_t worker) { ++calls; });
+    EXPECT_EQ(20, calls);
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include "permutation.h"
+#include "cpu.h"
 
 #include <cstdlib>
 
@@ -25,12 +26,53 @@ TEST(PermutationTest, ChooseTooMany)
     ASSERT_THROW(Simhash::Permutation::choose(population, 7), std::invalid_argument);
 }
 
+TEST(PermutationTest, Combinations)
+{
+    std::vector<Simhash::hash_t> population;
+    for (size_t i = 0; i < 9; ++i) {
+        population.push_back(i);
+    }
+    for (size_t r = 0; r <= population.size(); ++r) {
+        std::vector<std::vector<Simhash::hash_t> > expected =
+            Simhash::Permutation::choose(population, r);
+        EXPECT_EQ(expected.size(), Simhash::Combinations::count(population.size(), r));
+
+        // Starting at each rank continues from that combination
+        for (size_t rank = 0; rank < expected.size(); ++rank) {
+            std::vector<std::vector<Simhash::hash_t> > actual;
+            Simhash::Combinations combination(population.size(), r, rank);
+            for (; !combination.done(); combination.next()) {
+                actual.push_back(std::vector<Simhash::hash_t>(
+                    combination.indices(), combination.indices() + r));
+            }
+            EXPECT_EQ(std::vector<std::vector<Simhash::hash_t> >(
+                expected.begin() + rank, expected.end()), actual);
+        }
+    }
+    EXPECT_EQ(1832624140942590534UL, Simhash::Combinations::count(64, 32));
+    ASSERT_THROW(Simhash::Combinations(6, 7), std::invalid_argument);
+    ASSERT_THROW(Simhash::Combinations(6, 3, 20), std::invalid_argument);
+}
+
 TEST(PermutationTest, Create)
 {
     std::vector<Simhash::Permutation> permutations = Simhash::Permutation::create(6, 3);
     EXPECT_EQ(20, permutations.size());
 }
 
+TEST(PermutationTest, Nth)
+{
+    std::vector<Simhash::Permutation> permutations = Simhash::Permutation::create(10, 4);
+    ASSERT_EQ(permutations.size(), Simhash::Permutation::count(10, 4));
+    for (size_t i = 0; i < permutations.size(); ++i) {
+        Simhash::Permutation permutation = Simhash::Permutation::nth(10, 4, i);
+        EXPECT_EQ(permutations[i].masks(), permutation.masks());
+        EXPECT_EQ(permutations[i].search_mask(), permutation.search_mask());
+    }
+    ASSERT_THROW(Simhash::Permutation::nth(10, 4, permutations.size()), std::invalid_argument);
+    ASSERT_THROW(Simhash::Permutation::count(2, 3), std::invalid_argument);
+}
+
 TEST(PermutationTest, CreateTooManyBlocks)
 {
     ASSERT_THROW(
@@ -55,3 +97,70 @@ TEST(PermutationTest, Apply)
         }
     }
 }
+
+TEST(PermutationTest, TooManyMasks)
+{
+    std::vector<Simhash::hash_t> masks(Simhash::BITS + 1, 1);
+    ASSERT_THROW(Simhash::Permutation(3, masks), std::invalid_argument);
+}
+
+TEST(PermutationTest, ApplyMany)
+{
+    std::vector<Simhash::hash_t> hashes;
+    for (size_t i = 0; i < 37; ++i) {
+        hashes.push_back(
+            (static_cast<Simhash::hash_t>(rand()) << 32) ^ static_cast<Simhash::hash_t>(rand()));
+    }
+
+    Simhash::isa_t previous = Simhash::limit_isa(Simhash::ISA_SCALAR);
+    for (int isa = Simhash::ISA_SCALAR; isa <= Simhash::ISA_AVX512; ++isa) {
+        Simhash::limit_isa(static_cast<Simhash::isa_t>(isa));
+        for (const Simhash::Permutation& permutation : Simhash::Permutation::create(10, 4)) {
+            std::vector<Simhash::hash_t> permuted(hashes.size());
+            permutation.apply_many(hashes.data(), permuted.data(), hashes.size());
+            for (size_t i = 0; i < hashes.size(); ++i) {
+                EXPECT_EQ(permutation.apply(hashes[i]), permuted[i]);
+            }
+
+            // In place
+            permutation.apply_many(permuted.data(), permuted.data(), 0);
+            std::vector<Simhash::hash_t> copy(hashes);
+            permutation.apply_many(copy.data(), copy.data(), copy.size());
+            EXPECT_EQ(permuted, copy);
+        }
+    }
+    Simhash::limit_isa(previous);
+}
+
+TEST(PermutationTest, Owns)
+{
+    for (size_t blocks = 4; blocks < 10; ++blocks) {
+        std::vector<Simhash::Permutation> permutations = Simhash::Permutation::create(blocks, 3);
+        for (size_t i = 0; i < 200; ++i) {
+            Simhash::hash_t a =
+                (static_cast<Simhash::hash_t>(rand()) << 32) ^ static_cast<Simhash::hash_t>(rand());
+            Simhash::hash_t b = a;
+            for (size_t j = 0; j < i % 6; ++j) {
+                b ^= static_cast<Simhash::hash_t>(1) << (rand() % Simhash::BITS);
+            }
+
+            // Exactly one owner among the tables that share a prefix, and it's the first
+            int owners(0), first(-1), owner(-1);
+            for (size_t j = 0; j < permutations.size(); ++j) {
+                Simhash::hash_t mask = permutations[j].search_mask();
+                bool shared = (permutations[j].apply(a) & mask) == (permutations[j].apply(b) & mask);
+                if (shared && first < 0) {
+                    first = j;
+                }
+                if (permutations[j].owns(a, b)) {
+                    EXPECT_TRUE(shared);
+                    EXPECT_EQ(permutations[j].owns(a, b), permutations[j].owns(b, a));
+                    owner = j;
+                    ++owners;
+                }
+            }
+            EXPECT_EQ(first < 0 ? 0 : 1, owners);
+            EXPECT_EQ(first, owner);
+        }
+    }
+}
@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "permutation.h"
+#include "planner.h"
+
+namespace {
+
+    std::vector<Simhash::hash_t> uniform(size_t count)
+    {
+        std::mt19937_64 generator(count);
+        std::vector<Simhash::hash_t> hashes(count);
+        for (Simhash::hash_t& hash : hashes)
+        {
+            hash = generator();
+        }
+        return hashes;
+    }
+}
+
+TEST(PlannerTest, EstimateUniform)
+{
+    std::vector<Simhash::hash_t> hashes = uniform(100000);
+    Simhash::Plan plan = Simhash::estimate_plan(hashes.data(), hashes.size(), 4, 3);
+    EXPECT_EQ(4, plan.number_of_blocks);
+    EXPECT_EQ(3, plan.different_bits);
+    EXPECT_EQ(4, plan.tables);
+    EXPECT_EQ(4 * hashes.size() * sizeof(Simhash::hash_t), plan.memory);
+
+    // Each table has a 16-bit prefix
+    double expected = 4 * (100000.0 * 99999.0 / 2) / 65536;
+    EXPECT_GT(plan.comparisons, expected * 0.8);
+    EXPECT_LT(plan.comparisons, expected * 1.2);
+    EXPECT_GT(plan.seconds, 0);
+}
+
+TEST(PlannerTest, EstimateClustered)
+{
+    // Hashes that all agree on their leading bits share every prefix that
+    // lies within them far more often than uniform ones
+    std::vector<Simhash::hash_t> hashes = uniform(100000);
+    std::vector<Simhash::hash_t> clustered(hashes);
+    for (Simhash::hash_t& hash : clustered)
+    {
+        hash &= 0xFFFFFFFF;
+    }
+    Simhash::Plan plan = Simhash::estimate_plan(hashes.data(), hashes.size(), 8, 3);
+    Simhash::Plan skewed = Simhash::estimate_plan(clustered.data(), clustered.size(), 8, 3);
+    EXPECT_GT(skewed.comparisons, 100 * plan.comparisons);
+    EXPECT_GT(skewed.seconds, plan.seconds);
+}
+
+TEST(PlannerTest, EstimateDuplicates)
+{
+    // Duplicates are discarded before any comparisons
+    std::vector<Simhash::hash_t> hashes(50000, 12345);
+    Simhash::Plan plan = Simhash::estimate_plan(hashes.data(), hashes.size(), 6, 3);
+    EXPECT_EQ(20, plan.tables);
+    EXPECT_LT(plan.comparisons, 20 * 50000);
+}
+
+TEST(PlannerTest, Choose)
+{
+    std::vector<Simhash::hash_t> hashes = uniform(50000);
+    Simhash::Plan best = Simhash::choose_plan(hashes.data(), hashes.size(), 3);
+    EXPECT_EQ(3, best.different_bits);
+    EXPECT_EQ(Simhash::Permutation::count(best.number_of_blocks, 3), best.tables);
+    for (size_t blocks = 4; blocks <= 12; ++blocks)
+    {
+        Simhash::Plan plan = Simhash::estimate_plan(hashes.data(), hashes.size(), blocks, 3);
+        EXPECT_LE(best.seconds, plan.seconds) << blocks;
+    }
+}
+
+TEST(PlannerTest, ChooseWithinBudget)
+{
+    // With so many hashes, six blocks' 10-bit prefixes would be too small
+    std::vector<Simhash::hash_t> hashes = uniform(1000000);
+    Simhash::Plan plan = Simhash::choose_plan(hashes.data(), hashes.size(), 5);
+    ASSERT_GT(plan.number_of_blocks, 6);
+
+    // Six blocks means the fewest tables
+    size_t budget = 6 * hashes.size() * sizeof(Simhash::hash_t);
+    plan = Simhash::choose_plan(hashes.data(), hashes.size(), 5, budget);
+    EXPECT_EQ(6, plan.number_of_blocks);
+    EXPECT_EQ(6, plan.tables);
+    EXPECT_LE(plan.memory, budget);
+
+    // Nothing fits, so the fewest tables are used anyway
+    plan = Simhash::choose_plan(hashes.data(), hashes.size(), 5, 1);
+    EXPECT_EQ(6, plan.number_of_blocks);
+}
+
+TEST(PlannerTest, Describe)
+{
+    Simhash::Plan plan = { 6, 3, 20, 5000.4, 1 << 20, 0.25 };
+    EXPECT_EQ("6 blocks: 20 tables, about 5000 comparisons and 0.25s",
+              Simhash::describe_plan(plan));
+}
+
+TEST(PlannerTest, Invalid)
+{
+    std::vector<Simhash::hash_t> hashes = uniform(10);
+    ASSERT_THROW(Simhash::estimate_plan(hashes.data(), hashes.size(), 3, 3), std::invalid_argument);
+    ASSERT_THROW(Simhash::choose_plan(hashes.data(), hashes.size(), Simhash::BITS),
+                 std::invalid_argument);
+
+    // Too few hashes to compare at all
+    Simhash::Plan plan = Simhash::estimate_plan(hashes.data(), 1, 6, 3);
+    EXPECT_EQ(0, plan.comparisons);
+}
@@ -1,9 +1,14 @@
 #include <gtest/gtest.h>
 
 #include <algorithm>
+#include <cstdlib>
+#include <functional>
 #include <map>
+#include <random>
+#include <set>
 
 #include "simhash.h"
+#include "cpu.h"
 
 TEST(NumDifferingBitsTest, Basic)
 {
@@ -202,3 +207,355 @@ TEST(SimhashTest, FindClustersUnique)
     // 10 and 20 are 4 bits different
     EXPECT_EQ(sortClusters(expected), sortClusters(Simhash::find_clusters(hashes, 5, 4)));
 }
+
+TEST(SimhashTest, FindAllThreaded)
+{
+    std::unordered_set<Simhash::hash_t> hashes = {
+        0x00000000, 0x10101000, 0x10100010, 0x10001010, 0x00101010,
+                    0x01010100, 0x01010001, 0x01000101, 0x00010101,
+        0x000000FF, 0x000000EF, 0x000000EE, 0x000000CE, 0x00000033
+    };
+
+    for (size_t blocks = 4; blocks < 10; ++blocks)
+    {
+        Simhash::matches_t expected = Simhash::find_all(hashes, blocks, 3);
+        for (size_t threads = 0; threads < 5; ++threads)
+        {
+            EXPECT_EQ(expected, Simhash::find_all(hashes, blocks, 3, threads));
+        }
+    }
+}
+
+TEST(SimhashTest, FindClustersThreaded)
+{
+    std::unordered_set<Simhash::hash_t> hashes = {
+        0x000000FF, 0x000000EF, 0x000000EE, 0x000000CE, 0x00000033,
+        0x0000FF00, 0x0000EF00, 0x0000EE00, 0x0000CE00, 0x00003300
+    };
+    Simhash::clusters_t expected = {
+        { 0x000000FF, 0x000000EF, 0x000000EE, 0x000000CE },
+        { 0x0000FF00, 0x0000EF00, 0x0000EE00, 0x0000CE00 }
+    };
+
+    auto actual = Simhash::find_clusters(hashes, 6, 3, 4);
+    EXPECT_EQ(sortClusters(expected), sortClusters(actual));
+}
+
+TEST(SimhashTest, FindAllSorted)
+{
+    std::unordered_set<Simhash::hash_t> hashes = {
+        0x00000000, 0x10101000, 0x10100010, 0x10001010, 0x00101010,
+                    0x01010100, 0x01010001, 0x01000101, 0x00010101,
+        0x000000FF, 0x000000EF, 0x000000EE, 0x000000CE, 0x00000033
+    };
+
+    for (size_t blocks = 4; blocks < 10; ++blocks)
+    {
+        Simhash::matches_t matches = Simhash::find_all(hashes, blocks, 3);
+        Simhash::sorted_matches_t expected(matches.begin(), matches.end());
+        std::sort(expected.begin(), expected.end());
+        for (size_t threads = 1; threads < 4; ++threads)
+        {
+            EXPECT_EQ(expected, Simhash::find_all_sorted(hashes, blocks, 3, threads));
+        }
+    }
+}
+
+TEST(SimhashTest, FindAllSortedEmpty)
+{
+    std::unordered_set<Simhash::hash_t> hashes;
+    EXPECT_TRUE(Simhash::find_all_sorted(hashes, 6, 3).empty());
+}
+
+TEST(SimhashTest, FindAllSortedShards)
+{
+    // Random hashes, each with a few others near it
+    std::mt19937_64 generator(42);
+    std::vector<Simhash::hash_t> hashes;
+    for (size_t i = 0; i < 2000; ++i)
+    {
+        Simhash::hash_t hash = generator();
+        hashes.push_back(hash);
+        hashes.push_back(hash ^ (1ULL << (generator() % 64)));
+        hashes.push_back(hash ^ (1ULL << (generator() % 64)) ^ (1ULL << (generator() % 64)));
+    }
+    Simhash::sorted_matches_t expected =
+        Simhash::find_all_sorted(hashes.data(), hashes.size(), 6, 3);
+    ASSERT_FALSE(expected.empty());
+
+    // More shards than the 20 tables leaves some shards empty
+    for (size_t shards : { 1, 3, 7, 25 })
+    {
+        Simhash::sorted_matches_t merged;
+        for (size_t shard = 0; shard < shards; ++shard)
+        {
+            Simhash::sorted_matches_t matches = Simhash::find_all_sorted_shard(
+                hashes.data(), hashes.size(), 6, 3, shard, shards, 2);
+            EXPECT_TRUE(std::is_sorted(matches.begin(), matches.end()));
+            merged.insert(merged.end(), matches.begin(), matches.end());
+        }
+
+        // No match is in more than one shard
+        std::sort(merged.begin(), merged.end());
+        EXPECT_EQ(expected, merged) << shards;
+    }
+
+    ASSERT_THROW(Simhash::find_all_sorted_shard(hashes.data(), hashes.size(), 6, 3, 3, 3),
+                 std::invalid_argument);
+    ASSERT_THROW(Simhash::find_all_sorted_shard(hashes.data(), hashes.size(), 6, 3, 0, 0),
+                 std::invalid_argument);
+}
+
+/**
+ * The straightforward weighted simhash, for comparison.
+ */
+Simhash::hash_t reference_compute(const std::vector<Simhash::hash_t>& hashes,
+                                  const std::vector<int32_t>& weights)
+{
+    std::vector<int64_t> counts(Simhash::BITS, 0);
+    for (size_t i = 0; i < hashes.size(); ++i)
+    {
+        for (size_t bit = 0; bit < Simhash::BITS; ++bit)
+        {
+            counts[bit] += ((hashes[i] >> bit) & 1) ? weights[i] : -weights[i];
+        }
+    }
+
+    Simhash::hash_t result(0);
+    for (size_t bit = 0; bit < Simhash::BITS; ++bit)
+    {
+        if (counts[bit] > 0)
+        {
+            result |= static_cast<Simhash::hash_t>(1) << bit;
+        }
+    }
+    return result;
+}
+
+TEST(SimhashTest, ComputeEveryInstructionSet)
+{
+    // Enough hashes that the byte counters must be flushed several times
+    srand(42);
+    std::vector<Simhash::hash_t> hashes;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        // Skew the bits so that the result isn't just noise
+        Simhash::hash_t hash = (static_cast<Simhash::hash_t>(rand()) << 33) ^
+                               (static_cast<Simhash::hash_t>(rand()) << 11) ^ rand();
+        hashes.push_back(hash | (static_cast<Simhash::hash_t>(rand() % 3) << (i % 63)));
+    }
+    std::vector<int32_t> ones(hashes.size(), 1);
+    std::vector<int32_t> weights;
+    for (size_t i = 0; i < hashes.size(); ++i)
+    {
+        weights.push_back(rand() % 2001 - 1000);
+    }
+
+    Simhash::isa_t previous = Simhash::limit_isa(Simhash::ISA_SCALAR);
+    for (size_t count : { 0, 1, 2, 254, 255, 256, 999, 1000 })
+    {
+        std::vector<Simhash::hash_t> subset(hashes.begin(), hashes.begin() + count);
+        std::vector<int32_t> subset_ones(ones.begin(), ones.begin() + count);
+        std::vector<int32_t> subset_weights(weights.begin(), weights.begin() + count);
+        for (int isa = Simhash::ISA_SCALAR; isa <= Simhash::ISA_AVX512; ++isa)
+        {
+            Simhash::limit_isa(static_cast<Simhash::isa_t>(isa));
+            EXPECT_EQ(reference_compute(subset, subset_ones),
+                      Simhash::compute(subset.data(), count));
+            EXPECT_EQ(reference_compute(subset, subset_ones),
+                      Simhash::compute(subset.data(), subset_ones.data(), count));
+            EXPECT_EQ(reference_compute(subset, subset_weights),
+                      Simhash::compute(subset.data(), subset_weights.data(), count));
+        }
+    }
+    Simhash::limit_isa(previous);
+}
+
+TEST(SimhashTest, ComputeMany)
+{
+    std::vector<Simhash::hash_t> hashes = {
+        0xABCD, 0xBCDE, 0xCDEF,
+        0xDEADBEEF, ~0xDEADBEEF,
+        0xDEADBEEF
+    };
+    std::vector<int32_t> weights = { 1, 1, 1, 2, 1, 3 };
+    std::vector<size_t> offsets = { 0, 3, 5, 5, 6 };
+
+    std::vector<Simhash::hash_t> expected = { 0xADCF, 0, 0, 0xDEADBEEF };
+    for (size_t threads : { 1, 3 })
+    {
+        std::vector<Simhash::hash_t> results(4, 1);
+        Simhash::compute_many(
+            hashes.data(), nullptr, offsets.data(), 4, results.data(), threads);
+        EXPECT_EQ(expected, results);
+    }
+
+    // With its weight of 2, 0xDEADBEEF outweighs its inverse
+    expected = { 0xADCF, 0xDEADBEEF, 0, 0xDEADBEEF };
+    std::vector<Simhash::hash_t> results(4, 1);
+    Simhash::compute_many(hashes.data(), weights.data(), offsets.data(), 4, results.data());
+    EXPECT_EQ(expected, results);
+}
+
+TEST(NumDifferingBitsTest, EveryInstructionSet)
+{
+    Simhash::isa_t previous = Simhash::limit_isa(Simhash::ISA_SCALAR);
+    for (int isa = Simhash::ISA_SCALAR; isa <= Simhash::ISA_AVX512; ++isa)
+    {
+        Simhash::limit_isa(static_cast<Simhash::isa_t>(isa));
+        EXPECT_EQ(0, Simhash::num_differing_bits(0xDEADBEEF, 0xDEADBEEF));
+        EXPECT_EQ(2, Simhash::num_differing_bits(0xDEADBEEF, 0xDEADBEAD));
+        EXPECT_EQ(64, Simhash::num_differing_bits(0, ~static_cast<Simhash::hash_t>(0)));
+    }
+    Simhash::limit_isa(previous);
+}
+
+TEST(FindWithinTest, EveryInstructionSet)
+{
+    Simhash::hash_t query = 0xDEADBEEFDEADBEEF;
+    std::vector<Simhash::hash_t> candidates;
+    for (size_t i = 0; i < 203; ++i)
+    {
+        Simhash::hash_t candidate = query;
+        for (size_t j = 0; j < i % 7; ++j)
+        {
+            candidate ^= static_cast<Simhash::hash_t>(1) << ((i * 13 + j * 29) % 64);
+        }
+        candidates.push_back(candidate);
+    }
+
+    Simhash::isa_t previous = Simhash::limit_isa(Simhash::ISA_SCALAR);
+    for (size_t different_bits = 0; different_bits < 7; ++different_bits)
+    {
+        std::vector<size_t> expected;
+        for (size_t i = 0; i < candidates.size(); ++i)
+        {
+            if (Simhash::num_differing_bits(query, candidates[i]) <= different_bits)
+            {
+                expected.push_back(i);
+            }
+        }
+
+        for (int isa = Simhash::ISA_SCALAR; isa <= Simhash::ISA_AVX512; ++isa)
+        {
+            Simhash::limit_isa(static_cast<Simhash::isa_t>(isa));
+            std::vector<size_t> indices(candidates.size());
+            size_t found = Simhash::find_within(
+                query, candidates.data(), candidates.size(), different_bits, indices.data());
+            indices.resize(found);
+            EXPECT_EQ(expected, indices);
+        }
+    }
+    Simhash::limit_isa(previous);
+}
+
+TEST(SimhashTest, FindAllContiguous)
+{
+    std::vector<Simhash::hash_t> hashes = {
+        0x000000FF, 0x000000EF, 0x000000EE, 0x000000CE, 0x00000033,
+        0x000000FF, 0x000000EF, 0x0000FF00, 0x0000EF00, 0x0000EF00
+    };
+    std::unordered_set<Simhash::hash_t> unique(hashes.begin(), hashes.end());
+
+    Simhash::matches_t expected = Simhash::find_all(unique, 6, 3);
+    EXPECT_EQ(expected, Simhash::find_all(hashes.data(), hashes.size(), 6, 3));
+
+    Simhash::sorted_matches_t sorted(expected.begin(), expected.end());
+    std::sort(sorted.begin(), sorted.end());
+    EXPECT_EQ(sorted, Simhash::find_all_sorted(hashes.data(), hashes.size(), 6, 3));
+
+    // Sorted and deduplicated in place
+    EXPECT_EQ(sorted, Simhash::find_all_sorted(hashes, 6, 3));
+    std::vector<Simhash::hash_t> expected_hashes(unique.begin(), unique.end());
+    std::sort(expected_hashes.begin(), expected_hashes.end());
+    EXPECT_EQ(expected_hashes, hashes);
+}
+
+TEST(SimhashTest, FindClustersContiguous)
+{
+    std::vector<Simhash::hash_t> hashes = {
+        0x000000FF, 0x000000EF, 0x000000EE, 0x000000CE, 0x00000033,
+        0x000000FF, 0x000000EF, 0x0000FF00, 0x0000EF00, 0x0000EF00
+    };
+    Simhash::clusters_t expected = {
+        { 0x000000FF, 0x000000EF, 0x000000EE, 0x000000CE },
+        { 0x0000FF00, 0x0000EF00 }
+    };
+
+    auto actual = Simhash::find_clusters(hashes.data(), hashes.size(), 6, 3);
+    EXPECT_EQ(sortClusters(expected), sortClusters(actual));
+}
+
+TEST(SimhashTest, FindClustersMatchesPairs)
+{
+    // Chains of near-duplicates, some dense and some sparse, among unrelated
+    // hashes; the clusters are the components of the pairs find_all_sorted finds
+    srand(21);
+    std::vector<Simhash::hash_t> hashes;
+    for (size_t chain = 0; chain < 200; ++chain)
+    {
+        Simhash::hash_t hash = (static_cast<Simhash::hash_t>(rand()) << 33) ^
+            (static_cast<Simhash::hash_t>(rand()) << 11) ^ static_cast<Simhash::hash_t>(rand());
+        size_t flips = 1 + chain % 3;
+        for (size_t length = chain % 40; length > 0; --length)
+        {
+            hashes.push_back(hash);
+            for (size_t flip = 0; flip < flips; ++flip)
+            {
+                hash ^= static_cast<Simhash::hash_t>(1) << (rand() % Simhash::BITS);
+            }
+        }
+        hashes.push_back(hash);
+    }
+
+    std::vector<Simhash::hash_t> unique(hashes);
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+    std::map<Simhash::hash_t, Simhash::hash_t> parents;
+    std::function<Simhash::hash_t(Simhash::hash_t)> root = [&](Simhash::hash_t hash) {
+        return parents.count(hash) ? root(parents[hash]) : hash;
+    };
+    std::set<Simhash::hash_t> matched;
+    for (const Simhash::match_t& match : Simhash::find_all_sorted(unique, 6, 3))
+    {
+        matched.insert(match.first);
+        matched.insert(match.second);
+        Simhash::hash_t a = root(match.first), b = root(match.second);
+        if (a != b)
+        {
+            parents[std::max(a, b)] = std::min(a, b);
+        }
+    }
+    std::map<Simhash::hash_t, Simhash::cluster_t> components;
+    for (Simhash::hash_t hash : matched)
+    {
+        components[root(hash)].insert(hash);
+    }
+    Simhash::clusters_t expected;
+    for (const auto& component : components)
+    {
+        expected.push_back(component.second);
+    }
+
+    for (size_t threads = 1; threads <= 3; ++threads)
+    {
+        auto actual = Simhash::find_clusters(hashes.data(), hashes.size(), 6, 3, threads);
+        EXPECT_EQ(sortClusters(expected), sortClusters(actual));
+    }
+}
+
+TEST(SimhashTest, FindClustersDense)
+{
+    // Every hash differs from the first in at most one bit, and so from each
+    // other in at most two, so nearly all of them share each table's prefix
+    std::vector<Simhash::hash_t> hashes(1, 0x0123456789ABCDEFULL);
+    for (size_t bit = 0; bit < Simhash::BITS; ++bit)
+    {
+        hashes.push_back(hashes[0] ^ (static_cast<Simhash::hash_t>(1) << bit));
+    }
+    hashes.insert(hashes.end(), hashes.begin(), hashes.end());
+
+    Simhash::clusters_t actual = Simhash::find_clusters(hashes.data(), hashes.size(), 4, 3);
+    ASSERT_EQ(1, actual.size());
+    EXPECT_EQ(Simhash::BITS + 1, actual[0].size());
+}
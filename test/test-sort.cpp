@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "sort.h"
+
+namespace {
+
+    std::vector<Simhash::hash_t> random_hashes(size_t count)
+    {
+        std::vector<Simhash::hash_t> hashes;
+        for (size_t i = 0; i < count; ++i)
+        {
+            hashes.push_back(
+                (static_cast<Simhash::hash_t>(rand()) << 40) ^
+                (static_cast<Simhash::hash_t>(rand()) << 20) ^
+                 static_cast<Simhash::hash_t>(rand()));
+        }
+        return hashes;
+    }
+}
+
+TEST(SortTest, Empty)
+{
+    std::vector<Simhash::hash_t> hashes, scratch;
+    Simhash::radix_sort(hashes.data(), scratch.data(), 0);
+    EXPECT_TRUE(hashes.empty());
+}
+
+TEST(SortTest, Full)
+{
+    for (size_t count : { 10, 1000, 5000, 100000 })
+    {
+        for (size_t threads = 1; threads < 5; ++threads)
+        {
+            std::vector<Simhash::hash_t> hashes = random_hashes(count);
+            std::vector<Simhash::hash_t> scratch(hashes.size());
+            std::vector<Simhash::hash_t> expected(hashes);
+            std::sort(expected.begin(), expected.end());
+
+            Simhash::radix_sort(
+                hashes.data(), scratch.data(), hashes.size(), Simhash::BITS, threads);
+            EXPECT_EQ(expected, hashes);
+        }
+    }
+}
+
+TEST(SortTest, Duplicates)
+{
+    std::vector<Simhash::hash_t> hashes(5000, 0xDEADBEEF);
+    hashes[17] = 0xDEADBEEE;
+    std::vector<Simhash::hash_t> scratch(hashes.size());
+    std::vector<Simhash::hash_t> expected(hashes);
+    std::sort(expected.begin(), expected.end());
+
+    Simhash::radix_sort(hashes.data(), scratch.data(), hashes.size());
+    EXPECT_EQ(expected, hashes);
+}
+
+TEST(SortTest, Prefix)
+{
+    for (size_t bits : { 0, 5, 16, 21, 43, 64, 100 })
+    {
+        for (size_t threads = 1; threads < 5; ++threads)
+        {
+            std::vector<Simhash::hash_t> hashes = random_hashes(100000);
+            std::vector<Simhash::hash_t> scratch(hashes.size());
+            std::vector<Simhash::hash_t> expected(hashes);
+            std::sort(expected.begin(), expected.end());
+
+            Simhash::radix_sort(hashes.data(), scratch.data(), hashes.size(), bits, threads);
+
+            // The prefixes are in order, and all the hashes are still there
+            size_t shift = Simhash::BITS - std::min(bits, Simhash::BITS);
+            for (size_t i = 1; shift < Simhash::BITS && i < hashes.size(); ++i)
+            {
+                EXPECT_LE(hashes[i - 1] >> shift, hashes[i] >> shift);
+            }
+            std::sort(hashes.begin(), hashes.end());
+            EXPECT_EQ(expected, hashes);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "tables.h"
+
+TEST(TableTest, BoundsWithAndWithoutSamples)
+{
+    std::vector<Simhash::hash_t> hashes;
+    for (Simhash::hash_t i = 0; i < 100; ++i)
+    {
+        // Runs of equal hashes, some of which straddle samples
+        hashes.push_back(10 * (i / 3) + 5);
+    }
+
+    for (size_t stride : { 0, 1, 2, 3, 7, 100, 1000 })
+    {
+        std::vector<Simhash::hash_t> samples;
+        for (size_t i = 0; stride && i < hashes.size(); i += stride)
+        {
+            samples.push_back(hashes[i]);
+        }
+        Simhash::Table table = {
+            hashes.data(), hashes.size(), stride ? samples.data() : nullptr, stride };
+
+        for (Simhash::hash_t value = 0; value < 400; ++value)
+        {
+            EXPECT_EQ(std::lower_bound(hashes.begin(), hashes.end(), value) - hashes.begin(),
+                      table.lower_bound(value) - table.data);
+            EXPECT_EQ(std::upper_bound(hashes.begin(), hashes.end(), value) - hashes.begin(),
+                      table.upper_bound(value) - table.data);
+        }
+    }
+}
+
+TEST(TableTest, Empty)
+{
+    Simhash::hash_t sample(0);
+    Simhash::Table table = { nullptr, 0, &sample, 4 };
+    EXPECT_EQ(nullptr, table.lower_bound(5));
+    EXPECT_EQ(nullptr, table.upper_bound(5));
+}
+
+TEST(TableTest, BoundsWithDirectory)
+{
+    std::vector<Simhash::hash_t> hashes;
+    for (Simhash::hash_t i = 0; i < 300; ++i)
+    {
+        // Runs of equal hashes, bunched up in some prefixes and missing others
+        hashes.push_back((i / 3) * (i / 3) << 50);
+    }
+
+    for (size_t bits : { 0, 1, 4, 8 })
+    {
+        std::vector<uint64_t> directory(Simhash::directory_size(bits));
+        Simhash::build_directory(hashes.data(), hashes.size(), bits, directory.data());
+        EXPECT_EQ(0, directory.front());
+        EXPECT_EQ(hashes.size(), directory.back());
+
+        Simhash::Table table = {
+            hashes.data(), hashes.size(), nullptr, 0, directory.data(), bits };
+        for (Simhash::hash_t i = 0; i < 10000; ++i)
+        {
+            Simhash::hash_t value = i << 50;
+            for (Simhash::hash_t probe : { value - 1, value, value + 1 })
+            {
+                EXPECT_EQ(std::lower_bound(hashes.begin(), hashes.end(), probe) - hashes.begin(),
+                          table.lower_bound(probe) - table.data);
+                EXPECT_EQ(std::upper_bound(hashes.begin(), hashes.end(), probe) - hashes.begin(),
+                          table.upper_bound(probe) - table.data);
+            }
+        }
+    }
+}
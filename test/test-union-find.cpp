@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "union_find.h"
+
+TEST(UnionFindTest, Singletons)
+{
+    Simhash::UnionFind sets(5);
+    EXPECT_EQ(5, sets.size());
+    for (size_t i = 0; i < 5; ++i)
+    {
+        EXPECT_EQ(i, sets.find(i));
+    }
+    EXPECT_FALSE(sets.same(1, 2));
+}
+
+TEST(UnionFindTest, Unite)
+{
+    Simhash::UnionFind sets(6);
+    EXPECT_TRUE(sets.unite(4, 2));
+    EXPECT_TRUE(sets.unite(5, 4));
+    EXPECT_FALSE(sets.unite(2, 5));
+    EXPECT_TRUE(sets.unite(1, 3));
+
+    // Sets are rooted at their smallest member
+    EXPECT_EQ(2, sets.find(5));
+    EXPECT_EQ(1, sets.find(3));
+    EXPECT_TRUE(sets.same(2, 5));
+    EXPECT_FALSE(sets.same(3, 5));
+    EXPECT_EQ(0, sets.find(0));
+}
+
+TEST(UnionFindTest, Concurrent)
+{
+    // Each thread links every member of its own residue class in a chain
+    const size_t size = 1 << 16;
+    const size_t threads = 4;
+    const size_t classes = 8;
+    Simhash::UnionFind sets(size);
+
+    std::vector<std::thread> pool;
+    for (size_t worker = 0; worker < threads; ++worker)
+    {
+        pool.push_back(std::thread([&sets, worker]() {
+            srand(worker);
+            for (size_t i = 0; i < size * 2; ++i)
+            {
+                size_t a = rand() % size;
+                size_t b = (a + classes * (1 + rand() % 16)) % size;
+                sets.unite(a, b);
+            }
+            for (size_t i = worker; i + classes < size; i += threads)
+            {
+                sets.unite(i, i + classes);
+            }
+        }));
+    }
+    for (std::thread& thread : pool)
+    {
+        thread.join();
+    }
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        ASSERT_EQ(i % classes, sets.find(i));
+    }
+}